@@ -0,0 +1,36 @@
+#version 330 core
+
+// input data : one corner of the unit quad, then the instance's attributes
+layout (location = 0) in vec2 corner;      // -1..1
+layout (location = 1) in vec4 place;       // x, y, angle (radians), alive
+layout (location = 2) in vec4 extent;      // centre of the drawn extent, half width, half height
+layout (location = 3) in vec4 style;       // r, g, b, shape + 2*rank
+
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// Depth by rank (back walls, targets, fans, front walls), so they overlap
+// each other and the separately drawn bullet (z 0.2) as drawn one by one
+const float depth[4] = float[4](-0.3, 0.0, 0.1, 0.5);
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    vec2 c = corner;
+
+    // A triangle is the quad with both top corners pulled to the middle
+    if (mod(style.w, 2.0) == 1.0 && c.y > 0.0)
+        c.x = 0.0;
+
+    // Knocked-down blocks collapse to a point and draw nothing
+    vec2 p = (extent.xy + c*extent.zw) * place.w;
+    float s = sin(place.z), k = cos(place.z);
+    p = vec2(k*p.x - s*p.y, s*p.x + k*p.y) + place.xy;
+
+    fragColor = style.rgb;
+
+    gl_Position = VP * vec4(p, depth[int(style.w)/2], 1);
+}
@@ -3,20 +3,30 @@
 // input data : sent from main program
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexColor;
+layout (location = 2) in int objectIndex;    // this draw's entry in Objects
 
-uniform mat4 MVP;
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// Placement of every object drawn this frame: x, y, z, angle (radians)
+layout (std140) uniform Objects {
+    vec4 place[1024];
+};
 
 // output data : used by fragment shader
 out vec3 fragColor;
 
 void main ()
 {
-    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    vec4 p = place[objectIndex];
+    float s = sin(p.w), k = cos(p.w);
+    vec2 v = vec2(k*vertexPosition.x - s*vertexPosition.y, s*vertexPosition.x + k*vertexPosition.y);
 
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
     fragColor = vertexColor;
 
-    // Output position of the vertex, in clip space : MVP * position
-    gl_Position = MVP * v;
+    // Output position of the vertex, in clip space
+    gl_Position = VP * vec4(v + p.xy, vertexPosition.z + p.z, 1);
 }
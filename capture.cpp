@@ -0,0 +1,318 @@
+#include <cctype>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "glstate.h"
+#include "capture.h"
+#include "profile.h"
+
+using namespace std;
+
+enum CaptureSlotState { SLOT_FREE, SLOT_READY, SLOT_ENCODING, SLOT_ENCODED, SLOT_WRITING };
+
+static bool endsWith (const string& s, const char* tail)
+{
+    size_t n = strlen(tail);
+    return s.size() >= n && s.compare(s.size()-n, n, tail) == 0;
+}
+
+/* A numbered-frame pattern is only ever given one int, so it may hold
+ * exactly one %d (or %i) conversion, and %% */
+static bool framePattern (const char* path)
+{
+    int conversions = 0;
+    for (const char* p = path; *p; p++) {
+        if (*p != '%')
+            continue;
+        if (*++p == '%')
+            continue;
+        p += strspn(p, "-+ #0");
+        while (isdigit((unsigned char)*p))
+            p++;
+        if (*p != 'd' && *p != 'i')
+            return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+/* Run ffmpeg reading raw frames from a pipe, the output path passed as its
+ * own argument so no shell ever parses it. Returns the pipe's write end. */
+static FILE* startFfmpeg (Capture& c)
+{
+    int fd[2];
+    if (pipe2(fd, O_CLOEXEC) < 0)
+        return NULL;
+    string size = to_string(c.width) + "x" + to_string(c.height), rate = to_string(c.fps);
+    const char* argv[] = { "ffmpeg", "-loglevel", "error", "-y", "-f", "rawvideo", "-pix_fmt", "rgb24",
+            "-s", size.c_str(), "-r", rate.c_str(), "-i", "-", "-pix_fmt", "yuv420p", c.path.c_str(), NULL };
+    c.ffmpeg = fork();
+    if (c.ffmpeg == 0) {
+        dup2(fd[0], STDIN_FILENO);
+        execvp(argv[0], (char* const*)argv);
+        perror("ffmpeg");
+        _exit(127);
+    }
+    close(fd[0]);
+    if (c.ffmpeg < 0) {
+        close(fd[1]);
+        return NULL;
+    }
+    return fdopen(fd[1], "w");
+}
+
+/* RGBA rows bottom up to the output format's bytes */
+static void encode (const Capture& c, CaptureSlot& s)
+{
+    int w = c.width, h = c.height;
+    const unsigned char* src = s.rgba.data();
+    s.out.clear();
+    if (c.format == CAPTURE_Y4M) {
+        // BT.601 studio range; chroma averaged over each 2x2 block
+        static const char tag[] = "FRAME\n";
+        int cw = (w+1)/2, ch = (h+1)/2;
+        s.out.resize(sizeof(tag)-1 + w*h + 2*cw*ch);
+        memcpy(s.out.data(), tag, sizeof(tag)-1);
+        unsigned char* Y = s.out.data() + sizeof(tag)-1;
+        unsigned char* U = Y + w*h;
+        unsigned char* V = U + cw*ch;
+        for (int y=0; y<h; y++) {
+            const unsigned char* p = src + 4*(size_t)w*(h-1-y);
+            for (int x=0; x<w; x++, p+=4)
+                Y[y*w + x] = ((66*p[0] + 129*p[1] + 25*p[2] + 128) >> 8) + 16;
+        }
+        for (int y=0; y<ch; y++)
+            for (int x=0; x<cw; x++) {
+                int r = 0, g = 0, b = 0, n = 0;
+                for (int dy=0; dy<2 && 2*y+dy<h; dy++)
+                    for (int dx=0; dx<2 && 2*x+dx<w; dx++, n++) {
+                        const unsigned char* p = src + 4*((size_t)w*(h-1-(2*y+dy)) + 2*x+dx);
+                        r += p[0]; g += p[1]; b += p[2];
+                    }
+                r /= n; g /= n; b /= n;
+                U[y*cw + x] = ((-38*r - 74*g + 112*b + 128) >> 8) + 128;
+                V[y*cw + x] = ((112*r - 94*g - 18*b + 128) >> 8) + 128;
+            }
+        return;
+    }
+
+    char header[64];
+    int len = c.format == CAPTURE_PPM ? snprintf(header, sizeof(header), "P6\n%d %d\n255\n", w, h) : 0;
+    s.out.resize(len + 3*(size_t)w*h);
+    memcpy(s.out.data(), header, len);
+    unsigned char* dst = s.out.data() + len;
+    for (int y=0; y<h; y++) {
+        const unsigned char* p = src + 4*(size_t)w*(h-1-y);
+        for (int x=0; x<w; x++, p+=4, dst+=3) {
+            dst[0] = p[0]; dst[1] = p[1]; dst[2] = p[2];
+        }
+    }
+}
+
+static bool writeOut (Capture& c, const CaptureSlot& s)
+{
+    if (c.format != CAPTURE_PPM)
+        return fwrite(s.out.data(), s.out.size(), 1, c.file) == 1;
+    char name[1024];
+    snprintf(name, sizeof(name), c.path.c_str(), (int)s.frame);
+    FILE* f = fopen(name, "wb");
+    if (!f) {
+        perror(name);
+        return false;
+    }
+    bool ok = fwrite(s.out.data(), s.out.size(), 1, f) == 1;
+    return fclose(f) == 0 && ok;
+}
+
+/* Encode any ready frame; exit once closing and there are none */
+static void encodeLoop (Capture* cp)
+{
+    Capture& c = *cp;
+    unique_lock<mutex> hold(c.lock);
+    for (;;) {
+        CaptureSlot* s = NULL;
+        for (int i=0; i<CAPTURE_SLOTS && !s; i++)
+            if (c.slots[i].state == SLOT_READY)
+                s = &c.slots[i];
+        if (!s) {
+            if (c.closing)
+                return;
+            c.changed.wait(hold);
+            continue;
+        }
+        s->state = SLOT_ENCODING;
+        hold.unlock();
+        encode(c, *s);
+        hold.lock();
+        s->state = SLOT_ENCODED;
+        c.changed.notify_all();
+    }
+}
+
+/* Write encoded frames strictly in order; exit once all are written */
+static void writeLoop (Capture* cp)
+{
+    Capture& c = *cp;
+    unique_lock<mutex> hold(c.lock);
+    for (;;) {
+        CaptureSlot* s = NULL;
+        for (int i=0; i<CAPTURE_SLOTS && !s; i++)
+            if (c.slots[i].state == SLOT_ENCODED && c.slots[i].frame == c.written)
+                s = &c.slots[i];
+        if (!s) {
+            if (c.closing && c.written == c.submitted)
+                return;
+            c.changed.wait(hold);
+            continue;
+        }
+        s->state = SLOT_WRITING;
+        hold.unlock();
+        bool ok = c.failed || writeOut(c, *s);
+        hold.lock();
+        if (!ok && !c.failed) {
+            fprintf(stderr, "capture: writing frame %ld failed, dropping the rest\n", s->frame);
+            c.failed = true;
+        }
+        s->state = SLOT_FREE;
+        c.written++;
+        c.changed.notify_all();
+    }
+}
+
+bool startCapture (Capture& c, const char* path, int width, int height, int fps)
+{
+    c.path = path;
+    c.width = width;
+    c.height = height;
+    c.fps = fps;
+    c.file = NULL;
+    if (endsWith(c.path, ".y4m")) {
+        c.format = CAPTURE_Y4M;
+        c.file = fopen(path, "wb");
+        if (c.file)
+            fprintf(c.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+    }
+    else if (strchr(path, '%')) {
+        // The pattern is handed to snprintf as its format
+        if (!framePattern(path)) {
+            fprintf(stderr, "%s: a frame pattern needs exactly one %%d, and %%%% for a percent sign\n", path);
+            return false;
+        }
+        c.format = CAPTURE_PPM;
+    }
+    else {
+        // A pipe to a gone ffmpeg must fail the write, not kill the game
+        signal(SIGPIPE, SIG_IGN);
+        c.format = CAPTURE_FFMPEG;
+        c.file = startFfmpeg(c);
+    }
+    if (c.format != CAPTURE_PPM && !c.file) {
+        perror(path);
+        return false;
+    }
+
+    glGenBuffers(CAPTURE_LATENCY, c.pbo);
+    for (int i=0; i<CAPTURE_LATENCY; i++) {
+        setBuffer(GL_PIXEL_PACK_BUFFER, c.pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, 4*(size_t)width*height, NULL, GL_STREAM_READ);
+        c.fence[i] = 0;
+    }
+    setBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    for (int i=0; i<CAPTURE_SLOTS; i++)
+        c.slots[i].state = SLOT_FREE;
+    c.issued = c.submitted = c.written = 0;
+    c.closing = c.failed = false;
+    c.waits = 0;
+    for (int i=0; i<CAPTURE_ENCODERS; i++)
+        c.workers.push_back(thread(encodeLoop, &c));
+    c.workers.push_back(thread(writeLoop, &c));
+    c.start = profileClock();
+    printf("capture: %dx%d at %d fps to %s\n", width, height, fps, path);
+    return true;
+}
+
+/* Map the oldest read-back and hand it to the encoders */
+static void collect (Capture& c, int i)
+{
+    GLenum status = glClientWaitSync(c.fence[i], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        c.waits++;
+        while (status == GL_TIMEOUT_EXPIRED)
+            status = glClientWaitSync(c.fence[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    }
+    glDeleteSync(c.fence[i]);
+    c.fence[i] = 0;
+
+    CaptureSlot* s = NULL;
+    {
+        unique_lock<mutex> hold(c.lock);
+        for (bool waited = false; ; waited = true) {
+            for (int k=0; k<CAPTURE_SLOTS && !s; k++)
+                if (c.slots[k].state == SLOT_FREE)
+                    s = &c.slots[k];
+            if (s)
+                break;
+            if (!waited)
+                c.waits++;
+            c.changed.wait(hold);
+        }
+    }
+
+    size_t bytes = 4*(size_t)c.width*c.height;
+    s->rgba.resize(bytes);
+    setBuffer(GL_PIXEL_PACK_BUFFER, c.pbo[i]);
+    void* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (src)
+        memcpy(s->rgba.data(), src, bytes);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    setBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    lock_guard<mutex> hold(c.lock);
+    s->frame = c.submitted++;
+    s->state = SLOT_READY;
+    c.changed.notify_all();
+}
+
+void captureFrame (Capture& c)
+{
+    int i = c.issued % CAPTURE_LATENCY;
+    if (c.fence[i])
+        collect(c, i);
+    setBuffer(GL_PIXEL_PACK_BUFFER, c.pbo[i]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, c.width, c.height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+    setBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    c.fence[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    c.issued++;
+}
+
+void finishCapture (Capture& c)
+{
+    for (long n = c.issued < CAPTURE_LATENCY ? 0 : c.issued - CAPTURE_LATENCY; n < c.issued; n++)
+        collect(c, n % CAPTURE_LATENCY);
+    {
+        lock_guard<mutex> hold(c.lock);
+        c.closing = true;
+        c.changed.notify_all();
+    }
+    for (size_t i=0; i<c.workers.size(); i++)
+        c.workers[i].join();
+    c.workers.clear();
+    if (c.file && fclose(c.file) != 0)
+        c.failed = true;
+    if (c.format == CAPTURE_FFMPEG) {
+        int status;
+        if (waitpid(c.ffmpeg, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            c.failed = true;
+    }
+    c.file = NULL;
+    glDeleteBuffers(CAPTURE_LATENCY, c.pbo);
+
+    double seconds = profileClock() - c.start;
+    printf("capture: %ld frames %s %s in %.2f s, %.1f frames/s (%.1fx real time), renderer waited %ld times\n",
+            c.written, c.failed ? "(with errors) to" : "to", c.path.c_str(), seconds, c.written/seconds,
+            c.written/seconds/c.fps, c.waits);
+}
@@ -0,0 +1,80 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <glad/glad.h>
+
+/* Frame capture.
+ * Each frame is read back into the next of a ring of pixel buffer objects
+ * with a fence after it, and mapped CAPTURE_LATENCY frames later, by when
+ * the GPU has long finished the copy: the renderer never waits on
+ * glReadPixels. The mapped pixels go to a slot that CAPTURE_ENCODERS
+ * threads convert, and one writer thread writes out in frame order. The
+ * renderer only blocks if every slot is still busy.
+ *
+ * Where it goes depends on the path:
+ *   NAME.y4m           one YUV4MPEG2 (4:2:0) stream
+ *   NAME%05d.ppm       a numbered PPM per frame: one %d, with any flags
+ *                      and width, and %% for a literal percent sign
+ *   anything else      piped as raw RGB to ffmpeg, run with the path as
+ *                      its own argument (no shell), which picks the
+ *                      container and codec from the name (.mp4, .webm...) */
+
+#define CAPTURE_LATENCY  3      // frames between reading back and mapping
+#define CAPTURE_SLOTS    8      // frames being encoded or written at once
+#define CAPTURE_ENCODERS 2
+
+enum CaptureFormat { CAPTURE_Y4M, CAPTURE_PPM, CAPTURE_FFMPEG };
+
+struct CaptureSlot {
+    int state;                  // CaptureSlotState in capture.cpp
+    long frame;
+    std::vector<unsigned char> rgba;    // as read back, bottom row first
+    std::vector<unsigned char> out;     // encoded, ready to write
+};
+
+struct Capture {
+    int format;
+    int width, height, fps;
+    std::string path;
+    FILE* file;                 // the .y4m file or the ffmpeg pipe
+    pid_t ffmpeg;               // the process at the other end of the pipe
+
+    GLuint pbo[CAPTURE_LATENCY];
+    GLsync fence[CAPTURE_LATENCY];
+    long issued;                // frames read back
+    long submitted;             // frames handed to the encoders
+
+    CaptureSlot slots[CAPTURE_SLOTS];
+    std::mutex lock;            // guards the slots, written and closing
+    std::condition_variable changed;
+    long written;
+    bool closing;
+    bool failed;                // a write failed; the rest are dropped
+    std::vector<std::thread> workers;
+
+    long waits;                 // times the renderer waited for a fence or slot
+    double start;               // seconds, when capture started
+};
+
+/* Start capturing width x height frames shown at fps to path. Needs a
+ * current GL context. */
+bool startCapture (Capture& c, const char* path, int width, int height, int fps);
+
+/* Read back the frame just drawn, from the bound read framebuffer; call
+ * after drawing and before the swap */
+void captureFrame (Capture& c);
+
+/* Hand over the frames still in flight, wait for everything to be written,
+ * and print how fast it went */
+void finishCapture (Capture& c);
+
+#endif
@@ -0,0 +1,186 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+#include "world.h"
+
+using namespace std;
+
+/* Collision microbenchmark.
+ * Throws random one-tick ball paths at a spinning fan and times the swept
+ * ball-vs-blade test against the old end-of-tick point test, counting how
+ * many contacts each finds. Paths the point test misses but the sweep
+ * catches are shots that used to tunnel through the blade.
+ * Then times the target grid against sweeping every block, on levels of
+ * randomly placed bricks at constant density up to --bricks of them. Both
+ * sides run the same swept test, so their hit counts should agree. */
+
+struct Path {
+    float x0, y0, x1, y1;
+};
+
+/* Old check: ball centre within the blade's reach of its centre line, at
+ * the end of the tick only */
+static bool pointTest (const Barrier& b, float x, float y)
+{
+    float dx = x-b.x, dy = y-b.y;
+    float along = -dx*b.sin_rot + dy*b.cos_rot;
+    float across = dx*b.cos_rot + dy*b.sin_rot;
+    return abs(across) <= b.hw+BALL_RADIUS && abs(along) <= b.hh;
+}
+
+/* The same swept test as the grid, run over every block */
+static int bruteHit (const vector<Target>& targets, float x0, float y0, float x1, float y1, float& u)
+{
+    int best = -1;
+    u = 2;
+    for (size_t i=0; i<targets.size(); i++) {
+        if (targets[i].destroyed)
+            continue;
+        float e = segmentEntry(targets[i], x0, y0, x1-x0, y1-y0);
+        if (e >= 0 && e < u) {
+            u = e;
+            best = i;
+        }
+    }
+    return best;
+}
+
+static void benchGrid (int bricks, int queries, float speed, float dt)
+{
+    // About one brick per square unit, however many there are
+    float side = sqrt((float)bricks);
+    vector<Target> targets(bricks);
+    for (int i=0; i<bricks; i++) {
+        Target& t = targets[i];
+        memset(&t, 0, sizeof(t));
+        t.x = side*rand()/RAND_MAX;
+        t.y = side*rand()/RAND_MAX;
+        t.hx = 0.1f + 0.2f*rand()/RAND_MAX;
+        t.hy = 0.1f + 0.2f*rand()/RAND_MAX;
+        t.score = 1;
+    }
+    TargetGrid grid;
+    auto tb = chrono::steady_clock::now();
+    buildGrid(grid, targets);
+    double build_s = chrono::duration<double>(chrono::steady_clock::now() - tb).count();
+
+    vector<Path> paths(queries);
+    for (int i=0; i<queries; i++) {
+        float h = 2*M_PI*rand()/RAND_MAX;
+        paths[i].x0 = side*rand()/RAND_MAX;
+        paths[i].y0 = side*rand()/RAND_MAX;
+        paths[i].x1 = paths[i].x0 + speed*dt*cos(h);
+        paths[i].y1 = paths[i].y0 + speed*dt*sin(h);
+    }
+
+    long grid_hits = 0, brute_hits = 0;
+    float u;
+    auto t0 = chrono::steady_clock::now();
+    for (int i=0; i<queries; i++)
+        grid_hits += gridFirstHit(grid, targets, paths[i].x0, paths[i].y0, paths[i].x1, paths[i].y1, u) >= 0;
+    auto t1 = chrono::steady_clock::now();
+    for (int i=0; i<queries; i++)
+        brute_hits += bruteHit(targets, paths[i].x0, paths[i].y0, paths[i].x1, paths[i].y1, u) >= 0;
+    auto t2 = chrono::steady_clock::now();
+
+    printf("%8d bricks: %5dx%-5d cells, build %7.3f ms, grid %7.1f ns/step (%ld hits), all blocks %9.1f ns/step (%ld hits)\n",
+            bricks, grid.nx, grid.ny, build_s*1e3,
+            chrono::duration<double, nano>(t1-t0).count()/queries, grid_hits,
+            chrono::duration<double, nano>(t2-t1).count()/queries, brute_hits);
+}
+
+static void usage (const char* prog)
+{
+    printf("Usage: %s [--tests N] [--speed UNITS_PER_SEC] [--spin DEG_PER_SEC] [--dt SECONDS] [--bricks N]\n", prog);
+}
+
+int main (int argc, char** argv)
+{
+    int tests = 1000000, bricks = 100000;
+    float speed = 60, spin = BARRIER_SPIN, dt = 1.0f/240;
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--tests") && i+1<argc)
+            tests = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--speed") && i+1<argc)
+            speed = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--spin") && i+1<argc)
+            spin = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--dt") && i+1<argc)
+            dt = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--bricks") && i+1<argc)
+            bricks = atoi(argv[++i]);
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (tests < 1 || dt <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    World world;
+    initWorld(world, airPreset(1), gravityPreset(1));
+    Barrier fan = world.barriers[0];
+    fan.spin = spin;
+
+    // Paths start anywhere around the fan and head in any direction at up
+    // to the given speed; fan angles are spread over a full turn
+    srand(1);
+    vector<Path> paths(tests);
+    vector<Barrier> fans(tests, fan);
+    for (int i=0; i<tests; i++) {
+        float r = barrierReach(fan)*1.5f*rand()/RAND_MAX;
+        float a = 2*M_PI*rand()/RAND_MAX, h = 2*M_PI*rand()/RAND_MAX;
+        float v = speed*rand()/RAND_MAX;
+        paths[i].x0 = fan.x + r*cos(a);
+        paths[i].y0 = fan.y + r*sin(a);
+        paths[i].x1 = paths[i].x0 + v*dt*cos(h);
+        paths[i].y1 = paths[i].y0 + v*dt*sin(h);
+
+        Barrier& b = fans[i];
+        b.prev_rotation = 360.0f*rand()/RAND_MAX;
+        b.prev_cos = cos(b.prev_rotation*M_PI/180.0f);
+        b.prev_sin = sin(b.prev_rotation*M_PI/180.0f);
+        b.rotation = b.prev_rotation + spin*dt;
+        b.cos_rot = cos(b.rotation*M_PI/180.0f);
+        b.sin_rot = sin(b.rotation*M_PI/180.0f);
+    }
+
+    vector<char> swept(tests), point(tests);
+    Contact c;
+    auto t0 = chrono::steady_clock::now();
+    for (int i=0; i<tests; i++)
+        swept[i] = sweepBarrier(fans[i], paths[i].x0, paths[i].y0, paths[i].x1, paths[i].y1, dt, c);
+    auto t1 = chrono::steady_clock::now();
+    for (int i=0; i<tests; i++)
+        point[i] = pointTest(fans[i], paths[i].x1, paths[i].y1);
+    auto t2 = chrono::steady_clock::now();
+    double swept_s = chrono::duration<double>(t1-t0).count();
+    double point_s = chrono::duration<double>(t2-t1).count();
+
+    long swept_hits = 0, point_hits = 0, tunnelled = 0;
+    for (int i=0; i<tests; i++) {
+        swept_hits += swept[i];
+        point_hits += point[i];
+        tunnelled += (swept[i] && !point[i]);
+    }
+
+    printf("tests: %d\n", tests);
+    printf("max speed: %.1f units/s, spin: %.1f deg/s, dt: %.5f s\n", speed, spin, dt);
+    printf("swept hits: %ld\n", swept_hits);
+    printf("point hits: %ld\n", point_hits);
+    printf("missed by point test: %ld\n", tunnelled);
+    printf("swept: %.1f Mtests/s\n", tests/swept_s/1e6);
+    printf("point: %.1f Mtests/s\n", tests/point_s/1e6);
+
+    // Keep the brute-force side to a few times 10^8 block tests
+    for (int n=100; n<=bricks; n*=10)
+        benchGrid(n, (int)fmin(tests, 1e9/n), speed, dt);
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,15 @@
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
 #include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <glad/glad.h>
@@ -11,27 +20,57 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "world.h"
+#include "simthread.h"
+#include "level.h"
+#include "glstate.h"
+#include "ring.h"
+#include "renderqueue.h"
+#include "profile.h"
+#include "gputimer.h"
+#include "offscreen.h"
+#include "capture.h"
+
 using namespace std;
 
 struct VAO {
     GLuint VertexArrayID;
-    GLuint VertexBuffer;
-    GLuint ColorBuffer;
+    GLuint VertexBuffer;        // interleaved PackedVertex
+    GLuint IndexBuffer;         // the shared quad indices, or the object's own
 
     GLenum PrimitiveMode;
     GLenum FillMode;
     int NumVertices;
+    int NumIndices;
 };
 typedef struct VAO VAO;
 
 struct GLMatrices {
     glm::mat4 projection;
-    glm::mat4 model;
     glm::mat4 view;
-    GLuint MatrixID;
 } Matrices;
 
 GLuint programID;
+long drawcalls, frames;     // for the draw calls per frame printed at exit
+bool instanced = false;     // draw the level with one instanced call
+bool statecache = true;     // drop redundant GL state changes
+StreamRing streamring;      // per-frame placements and spinning instances
+SimThread sim;              // ticks the world; draw() reads its snapshots
+bool siminline = false;     // tick in draw() instead, as before the thread
+GpuTimer gputimer;          // GPU time of each frame's draws
+bool headless = false;      // draw into an offscreen framebuffer, no window
+Offscreen offscreen;
+Capture capture;            // every frame drawn, with --capture
+bool capturing = false;
+bool benchmark = false;     // --bench: scripted input, fixed clock, no vsync
+double headless_clock;      // seconds of 60 Hz frames drawn headless or benchmarking
+
+/* Seconds the frames go by: real time in a window, a fixed 60 Hz headless
+ * or benchmarking so a run draws the same frames every time */
+double gameTime ()
+{
+    return (headless || benchmark) ? headless_clock : glfwGetTime();
+}
 
 /* Function to load Shaders - Use it as it is */
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
@@ -117,105 +156,233 @@ static void error_callback(int error, const char* description)
 
 void quit(GLFWwindow *window)
 {
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (capturing)
+        finishCapture(capture);
+    stopSim(sim);
+    stopTrace();
+    if (window)
+        glfwDestroyWindow(window);
+    if (frames > 0)
+    {
+        printf("%s renderer: %.1f draw calls per frame\n", instanced ? "instanced" : "per-object", (double)drawcalls/frames);
+        printf("GL state changes per frame: %.1f made, %.1f elided%s\n", (double)glstate.issued/frames,
+                (double)glstate.elided/frames, statecache ? "" : " (cache off)");
+        printf("stream ring: waited for the GPU in %ld of %ld frames\n", streamring.waits, frames);
+        if (sim.input.dropped > 0)
+            printf("input: %ld events dropped on a full queue\n", sim.input.dropped);
+        printProfile(stdout);
+        if (gputimer.dropped > 0)
+            printf("gpu timer: %ld results not ready in time, dropped\n", gputimer.dropped);
+    }
+    if (headless)
+        destroyOffscreen(offscreen);
+    else
+        glfwTerminate();
     exit(EXIT_SUCCESS);
 }
 
 
-/* Generate VAO, VBOs and return VAO handle */
+/* Vertex as uploaded: half-float x, y and RGBA8 colour, 8 bytes against the
+ * 24 of separate float3 position and colour arrays. z is always 0 here. */
+struct PackedVertex {
+    GLhalf x, y;
+    GLubyte r, g, b, a;
+};
+
+/* Every quad is drawn as vertices 0 1 2 2 3 0 and a triangle as 0 1 2, so
+ * they all share one index buffer */
+static const GLushort quad_indices[] = { 0, 1, 2, 2, 3, 0 };
+GLuint quadIndexBuffer;
+
+/* Bytes of vertex and index data uploaded for meshes, and what the old
+ * unindexed float3 position + colour arrays would have taken */
+long meshbytes, meshbytes_unpacked, meshobjects;
+
+/* Mesh registry: objects with byte-identical packed geometry, colour and
+ * modes share one VAO. Entries are found by an FNV-1a hash of the packed
+ * data and confirmed by comparing the bytes. */
+struct MeshEntry {
+    std::string bytes;
+    VAO* vao;
+};
+std::unordered_multimap<uint64_t, MeshEntry> meshregistry;
+long meshhits;
+
+static uint64_t hashBytes (const std::string& bytes)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i=0; i<bytes.size(); i++)
+        hash = (hash ^ (unsigned char)bytes[i])*0x100000001b3ull;
+    return hash;
+}
+
+/* Upload the shared quad indices, before any object is created */
+void createQuadIndices ()
+{
+    glGenBuffers (1, &quadIndexBuffer);
+    setBuffer (GL_ARRAY_BUFFER, quadIndexBuffer);    // no VAO bound yet for GL_ELEMENT_ARRAY_BUFFER
+    glBufferData (GL_ARRAY_BUFFER, sizeof(quad_indices), quad_indices, GL_STATIC_DRAW);
+    meshbytes += sizeof(quad_indices);
+}
+
+/* Round a float to the nearest half */
+static GLhalf toHalf (float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    int exp = (int)((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = x & 0x7fffff;
+    if (exp >= 31)
+        return sign | 0x7c00;
+    if (exp <= 0) {
+        // Subnormal half, or too small for one
+        if (exp < -10)
+            return sign;
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        uint32_t h = mant >> shift;
+        if ((mant >> (shift-1)) & 1)
+            h++;
+        return sign | h;
+    }
+    uint32_t h = sign | (exp << 10) | (mant >> 13);
+    if (mant & 0x1000)
+        h++;                    // a carry into the exponent is still right
+    return h;
+}
+
+static GLubyte toByte (float c)
+{
+    return (GLubyte)(fmin(fmax(c, 0), 1)*255 + 0.5f);
+}
+
+/* Generate VAO, VBOs and return VAO handle.
+ * The float3 arrays are packed into interleaved PackedVertex and repeated
+ * vertices are merged into indices, so a quad uploads 4 vertices and draws
+ * through the shared quad index buffer. */
 struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
 {
+    std::vector<PackedVertex> vertices;
+    std::vector<GLushort> indices;
+    for (int i=0; i<numVertices; i++) {
+        const GLfloat* p = vertex_buffer_data + 3*i;
+        const GLfloat* c = color_buffer_data + 3*i;
+        PackedVertex v = { toHalf(p[0]), toHalf(p[1]), toByte(c[0]), toByte(c[1]), toByte(c[2]), 255 };
+        size_t k = 0;
+        while (k < vertices.size() && memcmp(&vertices[k], &v, sizeof(v)))
+            k++;
+        if (k == vertices.size())
+            vertices.push_back(v);
+        indices.push_back(k);
+    }
+    meshobjects++;
+    meshbytes_unpacked += 6*numVertices*sizeof(GLfloat);
+
+    // Reuse the VAO of an identical mesh if there is one
+    std::string bytes((const char*)&primitive_mode, sizeof(primitive_mode));
+    bytes.append((const char*)&fill_mode, sizeof(fill_mode));
+    bytes.append((const char*)indices.data(), indices.size()*sizeof(GLushort));
+    bytes.append((const char*)vertices.data(), vertices.size()*sizeof(PackedVertex));
+    uint64_t hash = hashBytes(bytes);
+    auto range = meshregistry.equal_range(hash);
+    for (auto it=range.first; it!=range.second; ++it)
+        if (it->second.bytes == bytes) {
+            meshhits++;
+            return it->second.vao;
+        }
+
     struct VAO* vao = new struct VAO;
     vao->PrimitiveMode = primitive_mode;
-    vao->NumVertices = numVertices;
     vao->FillMode = fill_mode;
+    vao->NumVertices = vertices.size();
+    vao->NumIndices = indices.size();
+    bool shared = indices.size() <= 6 && !memcmp(indices.data(), quad_indices, indices.size()*sizeof(GLushort));
 
     // Create Vertex Array Object
     // Should be done after CreateWindow and before any other GL calls
     glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
     glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
 
-    glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-    glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+    setVertexArray (vao->VertexArrayID); // Bind the VAO 
+    setBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
+    glBufferData (GL_ARRAY_BUFFER, vertices.size()*sizeof(PackedVertex), vertices.data(), GL_STATIC_DRAW); // Copy the vertices into VBO
     glVertexAttribPointer(
             0,                  // attribute 0. Vertices
-            3,                  // size (x,y,z)
-            GL_FLOAT,           // type
+            2,                  // size (x,y); z reads as 0
+            GL_HALF_FLOAT,      // type
             GL_FALSE,           // normalized?
-            0,                  // stride
+            sizeof(PackedVertex), // stride
             (void*)0            // array buffer offset
             );
-
-    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
     glVertexAttribPointer(
             1,                  // attribute 1. Color
             3,                  // size (r,g,b)
-            GL_FLOAT,           // type
-            GL_FALSE,           // normalized?
-            0,                  // stride
-            (void*)0            // array buffer offset
+            GL_UNSIGNED_BYTE,   // type
+            GL_TRUE,            // normalized?
+            sizeof(PackedVertex), // stride
+            (void*)offsetof(PackedVertex, r) // array buffer offset
             );
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    // The element buffer binding is part of the VAO
+    if (shared)
+        vao->IndexBuffer = quadIndexBuffer;
+    else
+        glGenBuffers (1, &(vao->IndexBuffer));
+    setBuffer (GL_ELEMENT_ARRAY_BUFFER, vao->IndexBuffer);
+    if (!shared)
+        glBufferData (GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
 
+    meshbytes += vertices.size()*sizeof(PackedVertex) + (shared ? 0 : indices.size()*sizeof(GLushort));
+    meshregistry.insert(std::make_pair(hash, MeshEntry { bytes, vao }));
     return vao;
 }
 
 /* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
 struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
 {
-    GLfloat* color_buffer_data = new GLfloat [3*numVertices];
+    std::vector<GLfloat> color_buffer_data(3*numVertices);
     for (int i=0; i<numVertices; i++) {
         color_buffer_data [3*i] = red;
         color_buffer_data [3*i + 1] = green;
         color_buffer_data [3*i + 2] = blue;
     }
 
-    return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+    return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data.data(), fill_mode);
 }
 
 /* Render the VBOs handled by VAO */
 void draw3DObject (struct VAO* vao)
 {
     // Change the Fill Mode for this object
-    glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
-
-    // Bind the VAO to use
-    glBindVertexArray (vao->VertexArrayID);
+    setPolygonMode (vao->FillMode);
 
-    // Enable Vertex Attribute 0 - 3d Vertices
-    glEnableVertexAttribArray(0);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
-
-    // Enable Vertex Attribute 1 - Color
-    glEnableVertexAttribArray(1);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+    // Bind the VAO to use; it holds the attribute layout and index buffer
+    setVertexArray (vao->VertexArrayID);
 
     // Draw the geometry !
-    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+    glDrawElements(vao->PrimitiveMode, vao->NumIndices, GL_UNSIGNED_SHORT, (void*)0);
+    drawcalls++;
 }
 
 /**************************
  * Customizable functions *
  **************************/
-//void resetbullet();
-double last_update_time = glfwGetTime(), current_time, t, powertimeend, powertimestart;
-float slab=0;
-float cannon_rot_angle=0;
-float triangle_rot_dir = 1;
-float rectangle_rot_dir = 1;
-bool triangle_rot_status = true;
-bool rectangle_rot_status = true;
-float cannon_rot_increment = 0;
-int flagscore=0, newflagcannon=0, oldflagcannon=0, bulletflag=0, resetbulletflag=0;
-float cannonrotflag=0;
-float ux=0,uy=0, vx, vy, sx=-7, sy=-4, ax, ay,powerfac=2;
-float cannon_rotation =0;
+World world;
+Level level;
+double last_update_time;
 float zoom=1, a=-12.0f, b=12.0f, c=-8.0f, d=8.0f;;
+bool camera_dirty = true;   // the camera block needs VP rewritten
+
+/* Projection for the current zoom; the camera block picks it up next frame */
+void setProjection ()
+{
+    Matrices.projection = glm::ortho(a*zoom, b*zoom, c*zoom, d*zoom, 0.1f, 500.0f);
+    camera_dirty = true;
+}
+
 /* Executed when a regular key is pressed/released/held-down */
 /* Prefered for Keyboard events */
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -223,10 +390,10 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     if(yoffset>0)
     {  if(zoom<=0.990)  
         zoom+=0.01;
-        Matrices.projection = glm::ortho(a*zoom, b*zoom, c*zoom, d*zoom, 0.1f, 500.0f);
+        setProjection();
     } else{
         zoom-=0.01;
-        Matrices.projection = glm::ortho(a*zoom, b*zoom, c*zoom, d*zoom, 0.1f, 500.0f);
+        setProjection();
     }}
 
 void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -237,20 +404,13 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
     {
         switch (key) {
             case GLFW_KEY_UP:
-                if(bulletflag!=1)
-                {
-                    cannonrotflag=1;    
-                    newflagcannon++;}
+                sendInput(sim, INPUT_TURN, 1);
                 break;
             case GLFW_KEY_DOWN:
-                if(bulletflag!=1)
-                {
-                    cannonrotflag=-1;    
-                    newflagcannon--;}
+                sendInput(sim, INPUT_TURN, -1);
                 break;
             case GLFW_KEY_SPACE:
-                if(bulletflag!=1)
-                    powertimestart=glfwGetTime();
+                sendInput(sim, INPUT_CHARGE, 0);
                 break;
 
         }
@@ -259,18 +419,13 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
     {
         switch (key) {
             case GLFW_KEY_SPACE:
-                if(bulletflag!=1)
-                { bulletflag=1;
-                    last_update_time=glfwGetTime();
-                    powertimeend=glfwGetTime();
-                    ux=((powertimeend-powertimestart)*powerfac)*cos(cannon_rotation*M_PI/180.0f); 
-                    uy=((powertimeend-powertimestart)*powerfac)*sin(cannon_rotation*M_PI/180.0f); }
+                sendInput(sim, INPUT_FIRE, 0);
                 break;
             case GLFW_KEY_UP:
-                cannonrotflag=0;
+                sendInput(sim, INPUT_TURN, 0);
                 break;
             case GLFW_KEY_DOWN:
-                cannonrotflag=0;
+                sendInput(sim, INPUT_TURN, 0);
                 break;
             default:
                 break;
@@ -289,17 +444,15 @@ void keyboardChar (GLFWwindow* window, unsigned int key)
         case 'o':
             if(zoom<=0.995)
                 zoom=zoom+0.005;
-            Matrices.projection = glm::ortho(a*zoom, b*zoom, c*zoom, d*zoom, 0.1f, 500.0f);
+            setProjection();
             break;
         case 'p':
             if(zoom>0.005)
                 zoom=zoom-0.005;
-            Matrices.projection = glm::ortho(a*zoom, b*zoom, c*zoom, d*zoom, 0.1f, 500.0f);
+            setProjection();
             break;
         case 'r':
-            bulletflag=0;
-            sx=-9+2*cos(cannon_rotation*M_PI/180.0f);
-            sy=-4+2*sin((cannon_rotation)*M_PI/180.0f);
+            sendInput(sim, INPUT_RELOAD, 0);
             break;
         default:
             break;
@@ -312,24 +465,13 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
     switch (button) {
         case GLFW_MOUSE_BUTTON_LEFT:
             if (action == GLFW_PRESS)
-            {
-                if(bulletflag!=1){
-                    powertimestart=glfwGetTime();}}
+                sendInput(sim, INPUT_CHARGE, 0);
             else if (action == GLFW_RELEASE)
-            {if(bulletflag!=1){
-                                  bulletflag=1;
-                                  last_update_time=glfwGetTime();
-                                  powertimeend=glfwGetTime();
-                                  ux=((powertimeend-powertimestart)*powerfac)*cos(cannon_rotation*M_PI/180.0f); 
-                                  uy=((powertimeend-powertimestart)*powerfac)*sin(cannon_rotation*M_PI/180.0f); 
-                              }}
+                sendInput(sim, INPUT_FIRE, 0);
             break;
         case GLFW_MOUSE_BUTTON_RIGHT:
-            if (action == GLFW_PRESS) {
-                bulletflag=0;
-                sx=-9+2*cos(cannon_rotation*M_PI/180.0f);
-                sy=-4+2*sin((cannon_rotation)*M_PI/180.0f);
-            }
+            if (action == GLFW_PRESS)
+                sendInput(sim, INPUT_RELOAD, 0);
             break;
         default:
             break;
@@ -344,7 +486,8 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
     int fbwidth=width, fbheight=height;
     /* With Retina display on Mac OS X, GLFW's FramebufferSize
        is different from WindowSize */
-    glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+    if (window)
+        glfwGetFramebufferSize(window, &fbwidth, &fbheight);
 
     GLfloat fov = 90.0f;
 
@@ -362,164 +505,12 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
     // Ortho projection for 2D views
     //     printf("%f\n",zoom);
     //   float a=-(12.0f)*zoom, b= (12.0f)*zoom, c=-(8.0f)*zoom, d=(8.0f)*zoom;
-    Matrices.projection = glm::ortho(a*zoom, b*zoom, c*zoom, d*zoom, 0.1f, 500.0f);
+    setProjection();
 }
 
-VAO *barrier1, *barrier2, *bullet, *triangle,*rectangleleft, *rectangleright, *rectanglesideup,*rectangle, *cannon, *square1, *square2, *rectangle1, *rectangle2, *rectangle3, *square3, *square4, *square5;
-
-// Creates the triangle object used in this sample code
-void createTriangle ()
-{
-    /* ONLY vertices between the bounds specified in glm::ortho will be visible on screen */
-
-    /* Define vertex array as used in glBegin (GL_TRIANGLES) */
-    static const GLfloat vertex_buffer_data [] = {
-        0, 1,0, // vertex 0
-        -1,-1,0, // vertex 1
-        1,-1,0, // vertex 2
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        1,0.5,0, // color 0
-        1,0.5,0, // color 1
-        1,0.5,0, // color 2
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    triangle = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-
-// Creates the rectangle object used in this sample code
-void createRectangle ()
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -12,-1,0, // vertex 1
-        -12,1,0, // vertex 2
-        12,1 ,0, // vertex 3
-
-        12, 1,0, // vertex 3
-        12,-1,0, // vertex 4
-        -12,-1,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.97,0.3,0.3, // color 1
-        0.97,0.3,0.3, // color 2
-        0.97,0.3,0.3, // color 3
-
-        0.97,0.3,0.3, // color 3
-        0.97,0.3,0.3, // color 4
-        0.97,0.3,0.3  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    rectangle = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createSquare1 ()
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -1,-1,0, // vertex 1
-        -1,1,0, // vertex 2
-        1,1 ,0, // vertex 3
-
-        1, 1,0, // vertex 3
-        1,-1,0, // vertex 4
-        -1,-1,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        1,1,0, // color 1
-        1,1,0, // color 2
-        1,1,0, // color 3
-
-        1,1,0, // color 3
-        1,1,0, // color 4
-        1,1,0  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    square1 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createSquare2 ()
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -1,-1,0, // vertex 1
-        -1,1,0, // vertex 2
-        1,1 ,0, // vertex 3
-
-        1, 1,0, // vertex 3
-        1,-1,0, // vertex 4
-        -1,-1,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        1,1,0, // color 1
-        1,1,0, // color 2
-        1,1,0, // color 3
-
-        1,1,0, // color 3
-        1,1,0, // color 4
-        1,1,0  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    square2 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createRectangle1 ()
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -0.5,-1.5,0, // vertex 1
-        -0.5,1.5,0, // vertex 2
-        0.5,1.5 ,0, // vertex 3
-
-        0.5, 1.5,0, // vertex 3
-        0.5,-1.5,0, // vertex 4
-        -0.5,-1.5,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.8,0.8,0, // color 1
-        0.8,0.8,0, // color 2
-        0.8,0.8,0, // color 3
-
-        0.8,0.8,0, // color 3
-        0.8,0.8,0, // color 4
-        0.8,0.8,0  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    rectangle1 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createRectangle2 ()
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -0.5,-1.5,0, // vertex 1
-        -0.5,1.5,0, // vertex 2
-        0.5,1.5 ,0, // vertex 3
-
-        0.5, 1.5,0, // vertex 3
-        0.5,-1.5,0, // vertex 4
-        -0.5,-1.5,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.8,0.8,0, // color 1
-        0.8,0.8,0, // color 2
-        0.8,0.8,0, // color 3
-
-        0.8,0.8,0, // color 3
-        0.8,0.8,0, // color 4
-        0.8,0.8,0  // color 1
-    };
+VAO *bullet, *cannon;
+std::vector<VAO*> levelobjects;     // one per level record
 
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    rectangle2 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
 void createCannon()
 {
 
@@ -547,166 +538,6 @@ void createCannon()
     // create3DObject creates and returns a handle to a VAO that can be used later
     cannon = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
-void createRectangle3()
-{
-
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -2.5,-0.5,0, // vertex 1
-        -2.5,0.5,0, // vertex 2
-        2.5,0.5 ,0, // vertex 3
-
-        2.5,0.5,0, // vertex 3
-        2.5,-0.5,0, // vertex 4
-        -2.5,-0.5,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.85,0.85,0, // color 1
-        0.85,0.85,0, // color 2
-        0.85,0.85,0, // color 3
-
-        0.85,0.85,0, // color 3
-        0.85,0.85,0, // color 4
-        0.85,0.85,0  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    rectangle3 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createBarrier1()
-{
-
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -0.15,-1.5,0, // vertex 1
-        -0.15,1.5,0, // vertex 2
-        0.15,1.5 ,0, // vertex 3
-
-        0.15,1.5,0, // vertex 3
-        0.15,-1.5,0, // vertex 4
-        -0.15,-1.5,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.4,0.8,0, // color 1
-        0.4,0.8,0, // color 2
-        0.4,0.8,0, // color 3
-
-        0.4,0.8,0, // color 3
-        0.4,0.8,0, // color 4
-        0.4,0.8,0  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    barrier1 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createBarrier2()
-{
-
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -0.15,-1.5,0, // vertex 1
-        -0.15,1.5,0, // vertex 2
-        0.15,1.5 ,0, // vertex 3
-
-        0.15,1.5,0, // vertex 3
-        0.15,-1.5,0, // vertex 4
-        -0.15,-1.5,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.4,0.8,0, // color 1
-        0.4,0.8,0, // color 2
-        0.4,0.8,0, // color 3
-
-        0.4,0.8,0, // color 3
-        0.4,0.8,0, // color 4
-        0.4,0.8,0  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    barrier2 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createSquare3 ()
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -2,-1,0, // vertex 1
-        -2,0.7,0, // vertex 2
-        2,0.7 ,0, // vertex 3
-
-        2, 0.7,0, // vertex 3
-        2,-1,0, // vertex 4
-        -2,-1,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.98,0.98,0, // color 1
-        0.98,0.98,0, // color 2
-        0.98,0.98,0, // color 3
-
-        0.98,0.98,0, // color 3
-        0.98,0.98,0, // color 4
-        0.98,0.98,0  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    square3 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-
-void createSquare4 ()
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -1,-0.5,0, // vertex 1
-        -1,0.5,0, // vertex 2
-        1,0.5 ,0, // vertex 3
-
-        1, 0.5,0, // vertex 3
-        1,-0.5,0, // vertex 4
-        -1,-0.5,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.96,0.96,0, // color 1
-        0.96,0.96,0, // color 2
-        0.96,0.96,0, // color 3
-
-        0.96,0.96,0, // color 3
-        0.96,0.96,0, // color 4
-        0.96,0.96,0  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    square4 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createSquare5 ()
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -0.25,-0.25,0, // vertex 1
-        -0.25,0.25,0, // vertex 2
-        0.25,0.25 ,0, // vertex 3
-
-        0.25, 0.25,0, // vertex 3
-        0.25,-0.25,0, // vertex 4
-        -0.25,-0.25,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.94,0.94,0, // color 1
-        0.94,0.94,0, // color 2
-        0.94,0.94,0, // color 3
-
-        0.94,0.94,0, // color 3
-        0.94,0.94,0, // color 4
-        0.94,0.94,0  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    square5 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
 
 void createBullet ()
 {
@@ -736,607 +567,502 @@ void createBullet ()
     bullet = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
-
-void createRectanglesideup()
+/* Build each level record's VAO from its shape, drawn extent and colour */
+void createLevelObjects ()
 {
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -12,-0.3,0, // vertex 1
-        -12,0.5,0, // vertex 2
-        12,0.5 ,0, // vertex 3
-
-        12, 0.5,0, // vertex 3
-        12,-0.3,0, // vertex 4
-        -12,-0.3,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.97,0.3,0.3, // color 1
-        0.97,0.3,0.3, // color 2
-        0.97,0.3,0.3, // color 3
-
-        0.97,0.3,0.3, // color 3
-        0.97,0.3,0.3, // color 4
-        0.97,0.3,0.3  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    rectanglesideup= create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+    levelobjects.resize(level.count);
+    for (int i=0; i<level.count; i++) {
+        const LevelObject& o = level.objects[i];
+        if (o.shape == LEVEL_TRIANGLE) {
+            // Apex top centre, base along the bottom
+            const GLfloat vertex_buffer_data [] = {
+                (o.left+o.right)/2,o.top,0, // vertex 0
+                o.left,o.bottom,0, // vertex 1
+                o.right,o.bottom,0, // vertex 2
+            };
+            levelobjects[i] = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, o.r, o.g, o.b, GL_FILL);
+        }
+        else {
+            // GL3 accepts only Triangles. Quads are not supported
+            const GLfloat vertex_buffer_data [] = {
+                o.left,o.bottom,0, // vertex 1
+                o.left,o.top,0, // vertex 2
+                o.right,o.top,0, // vertex 3
+
+                o.right,o.top,0, // vertex 3
+                o.right,o.bottom,0, // vertex 4
+                o.left,o.bottom,0  // vertex 1
+            };
+            levelobjects[i] = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, o.r, o.g, o.b, GL_FILL);
+        }
+    }
 }
 
-void createRectangleleft()
+/* Instanced renderer (--instanced).
+ * Every level record is an instance of one unit quad. Per instance, place
+ * (x, y, angle, alive) can change; extent and style never do. Instances
+ * that spin come first: their places are written to the stream ring every
+ * frame and drawn with one glDrawArraysInstanced, and the rest with
+ * another from a buffer where a knocked-down block only has its alive flag
+ * rewritten. Since draw order is lost, the shader gives each kind of
+ * object a depth that stacks them as the per-object path does. */
+struct Instances {
+    GLuint VertexArrayID;       // the moving instances, place from the ring
+    GLuint StillArrayID;        // the rest
+    GLuint QuadBuffer;          // unit quad corners
+    GLuint PlaceBuffer;         // x, y, angle, alive per instance that doesn't move
+    GLuint StaticBuffer;        // extent then style per instance
+    GLuint ProgramID;
+    int count;
+    int spinning_targets;       // first instances, then every fan
+    int moving;                 // instances re-uploaded every frame
+    std::vector<int> slot;      // level record -> instance
+    std::vector<glm::vec4> place;
+    size_t knocked_seen;        // world.knocked entries already applied
+} instances;
+
+void createInstances ()
 {
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -0.4,-8,0, // vertex 1
-        -0.4,8,0, // vertex 2
-        0.4,8 ,0, // vertex 3
-
-        0.4, 8,0, // vertex 3
-        0.4,-8,0, // vertex 4
-        -0.4,-8,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.97,0.3,0.3, // color 1
-        0.97,0.3,0.3, // color 2
-        0.97,0.3,0.3, // color 3
-
-        0.97,0.3,0.3, // color 3
-        0.97,0.3,0.3, // color 4
-        0.97,0.3,0.3  // color 1
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    rectangleleft= create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createRectangleright()
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    static const GLfloat vertex_buffer_data [] = {
-        -0.4,-8,0, // vertex 1
-        -0.4,8,0, // vertex 2
-        0.4,8 ,0, // vertex 3
-
-        0.4, 8,0, // vertex 3
-        0.4,-8,0, // vertex 4
-        -0.4,-8,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-        0.97,0.3,0.3, // color 1
-        0.97,0.3,0.3, // color 2
-        0.97,0.3,0.3, // color 3
+    Instances& in = instances;
+    in.count = level.count;
+    in.slot.assign(level.count, -1);
+    in.place.resize(level.count);
+    in.knocked_seen = 0;
+
+    // Spinning targets, then fans, then everything that never moves: the
+    // order of the snapshots' angles
+    int next = 0;
+    for (size_t i=0; i<sim.spinners.size(); i++)
+        in.slot[world.targets[sim.spinners[i]].object] = next++;
+    in.spinning_targets = next;
+    for (size_t i=0; i<world.barriers.size(); i++)
+        in.slot[world.barriers[i].object] = next++;
+    in.moving = next;
+    for (int i=0; i<level.count; i++)
+        if (in.slot[i] < 0)
+            in.slot[i] = next++;
+
+    std::vector<glm::vec4> statics(2*level.count);
+    for (int i=0; i<level.count; i++) {
+        const LevelObject& o = level.objects[i];
+        int k = in.slot[i];
+        in.place[k] = glm::vec4(o.x, o.y, 0, 1);
+        statics[2*k] = glm::vec4((o.left+o.right)/2, (o.bottom+o.top)/2, (o.right-o.left)/2, (o.top-o.bottom)/2);
+        int rank = (o.kind == LEVEL_WALL) ? 3*o.layer : (o.kind == LEVEL_TARGET) ? 1 : 2;
+        statics[2*k+1] = glm::vec4(o.r, o.g, o.b, (o.shape == LEVEL_TRIANGLE) + 2*rank);
+    }
 
-        0.97,0.3,0.3, // color 3
-        0.97,0.3,0.3, // color 4
-        0.97,0.3,0.3  // color 1
+    static const GLfloat corners [] = {
+        -1,-1, -1,1, 1,1,
+        1,1, 1,-1, -1,-1
     };
+    glGenBuffers(1, &in.QuadBuffer);
+    glGenBuffers(1, &in.PlaceBuffer);
+    glGenBuffers(1, &in.StaticBuffer);
+    setBuffer(GL_ARRAY_BUFFER, in.QuadBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    setBuffer(GL_ARRAY_BUFFER, in.PlaceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, (in.count-in.moving)*sizeof(glm::vec4), in.place.data()+in.moving, GL_DYNAMIC_DRAW);
+    setBuffer(GL_ARRAY_BUFFER, in.StaticBuffer);
+    glBufferData(GL_ARRAY_BUFFER, statics.size()*sizeof(glm::vec4), statics.data(), GL_STATIC_DRAW);
+
+    // The two VAOs differ in where place comes from and which instance
+    // their extent and style start at. The moving ones' place is pointed
+    // at this frame's copy in the ring by updateInstances.
+    glGenVertexArrays(1, &in.VertexArrayID);
+    glGenVertexArrays(1, &in.StillArrayID);
+    for (int v=0; v<2; v++) {
+        setVertexArray(v ? in.StillArrayID : in.VertexArrayID);
+        int first = v ? in.moving : 0;
+
+        setBuffer(GL_ARRAY_BUFFER, in.QuadBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+        setBuffer(GL_ARRAY_BUFFER, v ? in.PlaceBuffer : streamring.buffer);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        glVertexAttribDivisor(1, 1);
+
+        setBuffer(GL_ARRAY_BUFFER, in.StaticBuffer);
+        for (int a=0; a<2; a++) {
+            glEnableVertexAttribArray(2+a);
+            glVertexAttribPointer(2+a, 4, GL_FLOAT, GL_FALSE, 2*sizeof(glm::vec4), (void*)((2*first + a)*sizeof(glm::vec4)));
+            glVertexAttribDivisor(2+a, 1);
+        }
+    }
 
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    rectangleright= create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-int flagsquare5=0,flagrectangle1=0,flagrectangle2=0,flagsquare1=0,flagsquare2=0,flagsquare3=0,flagsquare4=0,flagrectangle3=0,flagtriangle=0;
-float camera_rotation_angle = 90;
-float rectangle_rotation = 0;
-float square5_rotation = 0;
-float bullet_rotation = 0;
-float triangle_rotation = 0;
-float barrier1_rotation=0;
-float barrier2_rotation=0;
-
-void resetprojectile()
-{
-    vx=ux+ax*t;
-    vy=uy+ay*t;
-    last_update_time=glfwGetTime();
+    in.ProgramID = LoadShaders("Instanced_GL.vert", "Sample_GL.frag");
 }
 
-int checkcollisionbarrier()
+/* Bring the places up to the snapshot: hide blocks knocked down since the
+ * last frame, and write the angles of everything that spins to the ring.
+ * False if the ring had no room for them. */
+bool updateInstances (const Snapshot& snap, float alpha)
 {
-
-    float dis1=abs(sy-(tan(barrier1_rotation*M_PI/180.0f))*sx -3 -tan(barrier1_rotation*M_PI/180.0f))/sqrt(1+tan(barrier1_rotation*M_PI/180.0f)*tan(barrier1_rotation*M_PI/180.0f));
-
-    float dis2=abs(sy-(tan(barrier2_rotation*M_PI/180.0f))*sx +3 -tan(barrier2_rotation*M_PI/180.0f))/sqrt(1+tan(barrier2_rotation*M_PI/180.0f)*tan(barrier2_rotation*M_PI/180.0f));
-
-    float dis3=sqrt(pow((sx+1),2)+pow((sy-3),2)); 
-    float dis4=sqrt(pow((sx+1),2)+pow((sy+3),2));
-
-    if((dis1<=0.3 && dis3<=1.5) || (dis2<=0.3 && dis4<=1.5))   
-    {
-        return 1;
+    Instances& in = instances;
+    setBuffer(GL_ARRAY_BUFFER, in.PlaceBuffer);
+    for (; in.knocked_seen < (size_t)snap.knocked; in.knocked_seen++) {
+        int k = in.slot[world.targets[world.knocked[in.knocked_seen]].object];
+        in.place[k].w = 0;
+        if (k >= in.moving)
+            glBufferSubData(GL_ARRAY_BUFFER, (k-in.moving)*sizeof(glm::vec4), sizeof(glm::vec4), &in.place[k]);
     }
-
+    for (int k=0; k<in.moving; k++)
+        in.place[k].z = lerpAngle(snap.prev_spin[k], snap.spin[k], alpha)*M_PI/180.0f;
+    if (in.moving == 0)
+        return true;
+    GLintptr offset;
+    void* dst = ringAlloc(streamring, in.moving*sizeof(glm::vec4), sizeof(glm::vec4), offset);
+    if (!dst)
+        return false;
+    memcpy(dst, in.place.data(), in.moving*sizeof(glm::vec4));
+    setVertexArray(in.VertexArrayID);
+    setBuffer(GL_ARRAY_BUFFER, streamring.buffer);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+    return true;
 }
 
-void cannonanglecheck()
+/* Every target, fan and wall: the moving ones, then the rest */
+void drawInstances ()
 {
-    if(cannonrotflag==1 && cannon_rotation<75)
-    {
-        cannon_rotation+=cannonrotflag;
-        sx=-9+2*cos(cannon_rotation*M_PI/180.0f);
-        sy=-4+2*sin((cannon_rotation)*M_PI/180.0f);
+    Instances& in = instances;
+    setProgram(in.ProgramID);
+    setPolygonMode(GL_FILL);
+    if (in.moving > 0) {
+        setVertexArray(in.VertexArrayID);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, in.moving);
+        drawcalls++;
     }
-    else if(cannonrotflag==-1 && cannon_rotation>-45)
-    {
-        cannon_rotation+=cannonrotflag;
-        sx=-9+2*cos(cannon_rotation*M_PI/180.0f);
-        sy=-4+2*sin(cannon_rotation*M_PI/180.0f);
+    if (in.count > in.moving) {
+        setVertexArray(in.StillArrayID);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, in.count - in.moving);
+        drawcalls++;
     }
 }
-/* Render the scene with openGL */
-/*Edit this function according to your assignment */
 
-void resetbullet()
+/* Uniform blocks shared by the shaders (std140). The camera block holds
+ * VP and is only rewritten when the zoom or window changes. The objects
+ * block holds each draw's placement, (x, y, z, angle in radians), filled
+ * once a frame in the stream ring and read by the vertex shader at the
+ * index the draw passes in; a block holds OBJECTS_PER_BLOCK of them (16KB,
+ * the least any GL 3.3 driver allows), and bigger frames bind the ring a
+ * block at a time. */
+#define CAMERA_BINDING      0
+#define OBJECTS_BINDING     1
+#define OBJECTS_PER_BLOCK   1024
+
+/* Sorting loses the recorded order, so each command is drawn this much
+ * further back than the one recorded after it, a few steps of a 24-bit
+ * depth buffer over the 0.1..500 range. A frame of more commands than fit
+ * in DEPTH_ROOM, the depth from z=0 back to just short of the far plane
+ * with the camera at z=3, gets a step that shares it out instead. */
+#define DEPTH_STEP          (1.0f/4096)
+#define DEPTH_ROOM          496.0f
+
+struct Transforms {
+    GLuint CameraBuffer;
+    GLintptr base;                  // this frame's placements in the ring
+} transforms;
+
+/* This frame's commands: buffers to record into (see draw()), then all of
+ * them merged and sorted */
+struct RenderQueue {
+    std::vector<CommandBuffer> buffers;
+    std::vector<RenderCommand> commands;
+    std::vector<RenderCommand> scratch;
+} renderqueue;
+int recordthreads = 1;      // threads recording the targets
+
+void createTransforms ()
 {
-    cannonanglecheck();
-    bulletflag=0;
+    glGenBuffers(1, &transforms.CameraBuffer);
+    setBuffer(GL_UNIFORM_BUFFER, transforms.CameraBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+    setBufferRange(CAMERA_BINDING, transforms.CameraBuffer, 0, sizeof(glm::mat4));
 }
 
-
-void draw ()
+/* Point a program's blocks at the shared binding points */
+void bindBlocks (GLuint program)
 {
-    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glUseProgram (programID);
-
-    // Eye - Location of camera. Don't change unless you are sure!!
-    glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
-    // Target - Where is the camera looking at.  Don't change unless you are sure!!
-    glm::vec3 target (0, 0, 0);
-    // Up - Up vector defines tilt of camera.  Don't change unless you are sure!!
-    glm::vec3 up (0, 1, 0);
-
-    // Compute Camera matrix (view)
-    // Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
-    //  Don't change unless you are sure!!
-    Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+    GLuint camera = glGetUniformBlockIndex(program, "Camera");
+    GLuint objects = glGetUniformBlockIndex(program, "Objects");
+    if (camera != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, camera, CAMERA_BINDING);
+    if (objects != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, objects, OBJECTS_BINDING);
+}
 
-    // Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
-    //  Don't change unless you are sure!!
+void updateCamera ()
+{
+    if (!camera_dirty)
+        return;
     glm::mat4 VP = Matrices.projection * Matrices.view;
+    setBuffer(GL_UNIFORM_BUFFER, transforms.CameraBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(VP), &VP[0][0]);
+    camera_dirty = false;
+}
 
-    // Send our transformation to the currently bound shader, in the "MVP" uniform
-    // For each model you render, since the MVP will be different (at least the M part)
-    //  Don't change unless you are sure!!
-    glm::mat4 MVP;	// MVP = Projection * View * Model
-
-    // Load identity to model matrix
-    Matrices.model = glm::mat4(1.0f);
-
-    /* Render your scene */
-
-    glm::mat4 translateTriangle = glm::translate (glm::vec3(6, -5, 0)); // glTranslatef
-    //STOPPING ROTATION OF TRIANGLE
-    // glm::mat4 rotateTriangle = glm::rotate((float)(triangle_rotation*M_PI/180.0f), glm::vec3(0,1,1));  // rotate about vector (1,0,0)
-    glm::mat4 triangleTransform = translateTriangle;// * rotateTriangle;
-    Matrices.model *= triangleTransform; 
-    MVP = VP * Matrices.model; // MVP = p * V * M
-
-    //  Don't change unless you are sure!!
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+/* Record a draw of vao placed at (x, y, z), turned by degrees */
+void queueObject (CommandBuffer& b, int layer, VAO* vao, float x, float y, float z, float degrees)
+{
+    recordCommand(b, renderKey(layer, 0, vao->FillMode == GL_FILL ? 0 : 1, vao->VertexArrayID), vao,
+            x, y, z, degrees*M_PI/180.0f);
+}
 
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    if((abs(sx-6)<=0.7) && (abs(sy+5)<=0.9)&& flagtriangle!=1)
-    {
-        flagscore+=25;
-        flagtriangle=1;
-        resetprojectile();
-        if(sx<5.3)
-        {
-            ux=-vx*(3/4);
-            sx=sx-0.3;
-        }
-        else if(sy>-4.1)
-        {
-            uy=-vy*(3/4);
-            sy=sy+0.3;
-        }
+/* Walls of one level layer, which never move */
+void queueWalls (CommandBuffer& b, int layer)
+{
+    for (int i=0; i<level.count; i++) {
+        const LevelObject& o = level.objects[i];
+        if (o.kind == LEVEL_WALL && o.layer == layer)
+            queueObject(b, layer ? LAYER_FRONT : LAYER_BACK, levelobjects[i], o.x, o.y, 0, 0);
     }
-    if(flagtriangle!=1)    
-        draw3DObject(triangle);
-
-    // Pop matrix to undo transformations till last push matrix instead of recomputing model matrix
-    // glPopMatrix ();
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    slab=slab+0.1;
-    glm::mat4 translateRectangle = glm::translate (glm::vec3(0, -7, 0));        // glTranslatef
-    Matrices.model *= (translateRectangle);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    draw3DObject(rectangle);
-
-
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateCannon = glm::translate (glm::vec3(-9, -4, 0));        // glTranslatef
-    glm::mat4 rotateCannon = glm::rotate((float)(cannon_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-    Matrices.model *= (translateCannon* rotateCannon);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    draw3DObject(cannon);
-
-
-    cannonanglecheck();
-
+}
 
+/* Targets standing in the snapshot. Only what never changes is read from
+ * the world, which the simulation thread is updating meanwhile. */
+std::vector<char> knocked_down;     // per target, as of the snapshot drawn
+size_t knocked_drawn;               // world.knocked entries marked in it
 
-    Matrices.model = glm::mat4(1.0f);
-    //slab=slab+0.1;
-    glm::mat4 translateSquare1 = glm::translate (glm::vec3(4, -5, 0));        // glTranslatef
-    Matrices.model *= (translateSquare1);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+void catchUpKnocked (const Snapshot& snap)
+{
+    knocked_down.resize(world.targets.size());
+    for (; knocked_drawn < (size_t)snap.knocked; knocked_drawn++)
+        knocked_down[world.knocked[knocked_drawn]] = 1;
+}
 
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    if((abs(sx-4)<=1.1) && (abs(sy+5)<=1.1) && flagsquare1!=1)
+/* Standing targets first..last-1; safe to run on several threads at once,
+ * each with its own buffer */
+void queueTargets (CommandBuffer* b, const Snapshot* snap, size_t first, size_t last, float alpha)
+{
+    for (size_t i=first; i<last; i++)
     {
-        flagscore+=10;
-        flagsquare1=1;
-        resetprojectile();
-        if(sx<3)
-        {
-            ux=-vx*(3/4);
-            sx=sx-0.3;
-        }
-        else if(sy>-4.1)
-        {
-            uy=-vy*(3/4);
-            sy=sy+0.3;
-        }
+        const Target& block = world.targets[i];
+        int m = sim.mover[i];
+        if (!knocked_down[i])
+            queueObject(*b, LAYER_LEVEL, levelobjects[block.object], block.x, block.y, 0,
+                    m < 0 ? 0 : lerpAngle(snap->prev_spin[m], snap->spin[m], alpha));
     }
-    if(flagsquare1!=1)    
-        draw3DObject(square1);
-
-
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateSquare2 = glm::translate (glm::vec3(8, -5, 0));        // glTranslatef
-    Matrices.model *= (translateSquare2);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+}
 
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    if((abs(sx-8)<=1.1) && (abs(sy+5)<=1.1) && flagsquare2!=1)
-    {
-        flagscore+=10;
-        flagsquare2=1;
-        resetprojectile();
-        if(sx<7)
-        {
-            ux=-vx*(3/4);
-            sx=sx-0.3;
-        }
-        else if(sy>-4)
-        {
-            uy=-vy*(3/4);
-            sy=sy+0.3;
-        }
+/* The recording threads after the first, started once and woken by
+ * recordTargets() each frame to fill their own buffer */
+struct Recorders {
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    long frame;                     // bumped to hand out a frame's work
+    int busy;                       // helpers still recording it
+    bool quit;
+    const Snapshot* snap;
+    float alpha;
+} recorders;
+
+void recorderLoop (int t)
+{
+    long seen = 0;
+    std::unique_lock<std::mutex> hold(recorders.lock);
+    for (;;) {
+        recorders.wake.wait(hold, [&]{ return recorders.quit || recorders.frame != seen; });
+        if (recorders.quit)
+            return;
+        seen = recorders.frame;
+        const Snapshot* snap = recorders.snap;
+        float alpha = recorders.alpha;
+        hold.unlock();
+        size_t n = world.targets.size();
+        queueTargets(&renderqueue.buffers[1+t], snap, n*t/recordthreads, n*(t+1)/recordthreads, alpha);
+        hold.lock();
+        if (--recorders.busy == 0)
+            recorders.done.notify_one();
     }
-    if(flagsquare2!=1)    
-        draw3DObject(square2);
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    //slab=slab+0.1;
-    glm::mat4 translateSquare3 = glm::translate (glm::vec3(6, -2, 0));        // glTranslatef
-    Matrices.model *= (translateSquare3);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+}
 
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    if((abs(sx-6)<=2.1) && (abs(sy+2)<=0.8) && flagsquare3!=1)
+void stopRecorders ()
+{
     {
-        flagscore+=5;
-        flagsquare3=1;
-        resetprojectile();
-        if(sx<4.1)
-        {
-            ux=-vx*(3/4);
-            sx=sx-0.3;
-        }
-        else if(sy>-1.4)
-        {
-            uy=-vy*(3/4);
-            sy=sy+0.3;
-        }
+        std::lock_guard<std::mutex> hold(recorders.lock);
+        recorders.quit = true;
+        recorders.wake.notify_all();
     }
-    if(flagsquare3!=1)    
-        draw3DObject(square3);
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateSquare4 = glm::translate (glm::vec3(6, -0.8, 0));        // glTranslatef
-    Matrices.model *= (translateSquare4);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    for (size_t t=0; t<recorders.threads.size(); t++)
+        recorders.threads[t].join();
+    recorders.threads.clear();
+}
 
-    if((abs(sx-6)<=1.1) && (abs(sy+0.8)<=0.6) && flagsquare4!=1)
-    {
-        flagscore+=5;
-        flagsquare4=1;
-        resetprojectile();
-        if(sx<5.01)
-        {
-            ux=-vx*(3/4);
-            sx=sx-0.3;
-        }
-        else if(sy>-0.35)
-        {
-            uy=-vy*(3/4);
-            sy=sy+0.3;
+/* Split the standing targets over recordthreads threads, this one
+ * included, into buffers 1..recordthreads */
+void recordTargets (const Snapshot& snap, float alpha)
+{
+    size_t n = world.targets.size();
+    int helpers = recordthreads-1;
+    if (helpers > 0) {
+        // Joined at exit, whichever way the program ends, before the
+        // destructors of what they wait on run
+        if (recorders.threads.empty()) {
+            for (int t=1; t<=helpers; t++)
+                recorders.threads.push_back(std::thread(recorderLoop, t));
+            atexit(stopRecorders);
         }
+        std::lock_guard<std::mutex> hold(recorders.lock);
+        recorders.snap = &snap;
+        recorders.alpha = alpha;
+        recorders.busy = helpers;
+        recorders.frame++;
+        recorders.wake.notify_all();
     }
-    if(flagsquare4!=1)    
-        draw3DObject(square4);
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    //slab=slab+0.1;
-    glm::mat4 translateSquare5 = glm::translate (glm::vec3(6,0.25 , 0));        // glTranslatef
-    glm::mat4 rotateSquare5 = glm::rotate((float)(square5_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-    Matrices.model *= (translateSquare5 * rotateSquare5);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    if((abs(sx-6)<=0.35) && (abs(sy-0.25)<=0.35) &&flagsquare5!=1)
-    {
-        flagscore+=20;
-        flagsquare5=1;
-        resetprojectile();
-        if(sx<5.75)
-        {
-            ux=-vx*(3/4);
-            uy=-vy*(3/4);
-            sx=sx-0.3;
-        }
-        else if(sy>0.50)
-        {
-            uy=-vy*(3/4);
-            ux=-vx*(3/4);
-            sy=sy+0.3;
-        }
+    queueTargets(&renderqueue.buffers[1], &snap, 0, n/recordthreads, alpha);
+    if (helpers > 0) {
+        std::unique_lock<std::mutex> hold(recorders.lock);
+        recorders.done.wait(hold, []{ return recorders.busy == 0; });
     }
-    if(flagsquare5!=1)    
-        draw3DObject(square5);
-
-    //  Increment angles
-    float increments = 3;
-
-    square5_rotation = square5_rotation + increments; //*rectangle_rot_dir*rectangle_rot_status;
-
-
-
+}
 
 
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateRectangle1 = glm::translate (glm::vec3(2.5, -4.5, 0));        // glTranslatef
-    Matrices.model *= (translateRectangle1);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+/* Ring space this frame's placements take: whole blocks, so the last one
+ * bound is in range */
+size_t transformBytes ()
+{
+    size_t blocks = (renderqueue.commands.size() + OBJECTS_PER_BLOCK-1)/OBJECTS_PER_BLOCK;
+    return blocks*OBJECTS_PER_BLOCK*sizeof(glm::vec4);
+}
 
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    if((abs(sx-2.5)<=0.6) && (abs(sy+4.5)<=1.6) && flagrectangle1!=1) 
-    {
-        flagscore+=3;
-        flagrectangle1=1;
-        resetprojectile();
-        if(sx<2)
-        {
-            ux=-vx*(3/4);
-            sx=sx-0.3;
-        }
-        else if(sy>-3.1)
-        {
-            uy=-vy*(3/4);
-            sy=sy+0.3;
-        }
+/* Copy every placement into the ring in sorted order, moving each back by
+ * how many commands were recorded after it. False if the ring had no room,
+ * in which case nothing at transforms.base is this frame's. */
+bool uploadTransforms ()
+{
+    const std::vector<RenderCommand>& c = renderqueue.commands;
+    glm::vec4* dst = (glm::vec4*)ringAlloc(streamring, transformBytes(), 256, transforms.base);
+    if (!dst)
+        return false;
+    float step = c.size() > 1 ? fmin(DEPTH_STEP, DEPTH_ROOM/(c.size()-1)) : DEPTH_STEP;
+    for (size_t i=0; i<c.size(); i++) {
+        size_t later = c.size()-1 - (c[i].key & KEY_SEQUENCE_MASK);
+        dst[i] = glm::vec4(c[i].x, c[i].y, c[i].z - later*step, c[i].angle);
     }
-    if(flagrectangle1!=1)    
-        draw3DObject(rectangle1);
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateRectangle2 = glm::translate (glm::vec3(9.5, -4.5, 0));        // glTranslatef
-    Matrices.model *= (translateRectangle2);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    return true;
+}
 
-    if((abs(sx-9.5)<=0.6) && (abs(sy+4.5)<=1.6) &&flagrectangle2!=1 )
-    {
-        flagscore+=7;
-        flagrectangle2=1;
-        resetprojectile();
-        if(sx<9.01)
-        {
-            ux=-vx*(3/4);
-            sx=sx-0.3;
+/* Submit the sorted commands. An object draw passes its index in the bound
+ * block as a constant vertex attribute; a command without a mesh is the
+ * instanced level. Each run of draws of one mesh is a span in the trace. */
+void submitCommands ()
+{
+    const std::vector<RenderCommand>& c = renderqueue.commands;
+    size_t bound = (size_t)-1;
+    const VAO* batch = NULL;
+    for (size_t i=0; i<c.size(); i++) {
+        if (tracing && c[i].mesh != batch) {
+            if (batch)
+                traceEvent("draw3DObject batch", 'E');
+            if (c[i].mesh)
+                traceEvent("draw3DObject batch", 'B');
+            batch = c[i].mesh;
         }
-        else if(sy>-3.01)
-        {
-            uy=-vy*(3/4);
-            sy=sy+0.3;
+        if (!c[i].mesh) {
+            drawInstances();
+            continue;
         }
+        size_t block = i/OBJECTS_PER_BLOCK;
+        if (block != bound) {
+            setBufferRange(OBJECTS_BINDING, streamring.buffer,
+                    transforms.base + block*OBJECTS_PER_BLOCK*sizeof(glm::vec4), OBJECTS_PER_BLOCK*sizeof(glm::vec4));
+            bound = block;
+        }
+        setProgram(programID);
+        setObjectIndex(i%OBJECTS_PER_BLOCK);
+        draw3DObject(c[i].mesh);
     }
-    if(flagrectangle2!=1)    
-        draw3DObject(rectangle2);
+    if (batch)
+        traceEvent("draw3DObject batch", 'E');
+}
 
+/* Render the scene with openGL */
+/*Edit this function according to your assignment */
+void draw ()
+{
+    ProfileScope frame(ZONE_DRAW);
+
+    // Draw the newest snapshot alpha of the way from its previous tick,
+    // running the simulation up to now first if it has no thread
+    double current_time = gameTime();
+    float alpha = siminline ? advanceSim(sim, current_time - last_update_time) : 0;
+    last_update_time = current_time;
+    const Snapshot& snap = latestSnapshot(sim);
+    if (!siminline)
+        alpha = snapshotAlpha(sim, snap, simNow(sim));
+
+    double build = beginZone(ZONE_BUILD);
+    beginGpuTimer(gputimer);
+    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    setProgram (programID);
+    updateCamera();
 
-    Matrices.model = glm::mat4(1.0f);
-    //slab=slab+0.1;
-    glm::mat4 translateRectangle3 = glm::translate (glm::vec3(6, -3.5, 0));        // glTranslatef
-    Matrices.model *= (translateRectangle3);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    /* Render your scene */
 
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    if((abs(sx-6)<=2.6) && (abs(sy+3.5)<=0.6) && flagrectangle3!=1)
-    {
-        flagscore+=7;
-        flagrectangle3=1;
-        resetprojectile();
-        if(sx<3.52)
-        {
-            ux=-vx*(3/4);
-            sx=sx-0.3;
-        }
-        else if(sy>-3.01)
+    // Record everything, back to front: the back walls and cannon, then
+    // the targets split between the recording threads, then the fans, ball
+    // and front walls, each with its level record's VAO. An instanced
+    // level is one command in place of the targets and fans.
+    int threads = instanced ? 0 : recordthreads;
+    std::vector<CommandBuffer>& buffers = renderqueue.buffers;
+    buffers.resize(threads+2);
+    for (size_t i=0; i<buffers.size(); i++)
+        buffers[i].commands.clear();
+
+    CommandBuffer& before = buffers[0];
+    CommandBuffer& after = buffers[threads+1];
+    if (!instanced)
+        queueWalls(before, 0);
+    queueObject(before, LAYER_CANNON, cannon, CANNON_X, CANNON_Y, 0, lerpAngle(snap.prev_cannon_rotation, snap.cannon_rotation, alpha));
+
+    if (instanced)
+        recordCommand(before, renderKey(LAYER_LEVEL, 1, 0, 0), NULL, 0, 0, 0, 0);
+    else {
+        catchUpKnocked(snap);
+        recordTargets(snap, alpha);
+
+        size_t first = sim.spinners.size();
+        for (size_t i=0; i<world.barriers.size(); i++)
         {
-            uy=-vy*(3/4);
-            sy=sy+0.3;
+            const Barrier& fan = world.barriers[i];
+            queueObject(after, LAYER_LEVEL, levelobjects[fan.object], fan.x, fan.y, 0,
+                    lerpAngle(snap.prev_spin[first+i], snap.spin[first+i], alpha));
         }
     }
-    if(flagrectangle3!=1)    
-        draw3DObject(rectangle3);
-
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    //slab=slab+0.1;
-    glm::mat4 translateBarrier1 = glm::translate (glm::vec3(-1, 3, 0));        // glTranslatef
-    //STOPPING ROTATION OF RECTANGLE
-    glm::mat4 rotateBarrier1 = glm::rotate((float)(barrier1_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-    Matrices.model *= ((translateBarrier1)* rotateBarrier1);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    draw3DObject(barrier1);
-
-    // Increment angles
-    float barrier1increments = 2;
-
-    //camera_rotation_angle++; // Simulating camera rotation
-    barrier1_rotation = barrier1_rotation - barrier1increments;
-    // printf("%f\n",barrier1_rotation); 
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    //slab=slab+0.1;
-    glm::mat4 translateBarrier2 = glm::translate (glm::vec3(-1, -3, 0));        // glTranslatef
-    //STOPPING ROTATION OF RECTANGLE
-    glm::mat4 rotateBarrier2 = glm::rotate((float)(barrier2_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-    Matrices.model *=((translateBarrier2) * rotateBarrier2);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    draw3DObject(barrier2);
-
-    // Increment angles
-    float barrier2increments = 2;
-
-    //camera_rotation_angle++; // Simulating camera rotation
-    barrier2_rotation = barrier2_rotation + barrier2increments;
-
-
-
-
-
-    vx=ux+ax*t;
-    vy=uy+ay*t;
-
-    if(resetbulletflag==1)
-        resetbullet();
-    if(vx<0.01)
-        ax=0;
-    current_time = glfwGetTime();
-
-    t= current_time - last_update_time;
-    t=t/5;
-    if(bulletflag==1)
-    {
-        sx= sx+  ux*t+(0.5)*ax*t*t;
-        sy= sy+ uy*t+(0.5)*ay*t*t;
-    }
-    int mmm=checkcollisionbarrier();
 
-    if(mmm==1)
-    {
-        sx=sx-0.3;
-        if((sy>=-3 && sy<=-1.5) || (sy >=3 && sy<=4.5))
-            uy+=0.5;
-        else if((sy<-3 && sy>=-4.5) || (sy <3 && sy >=1.5))
-            uy-=0.5;
-        resetprojectile();
-        ux=-vx;
-        mmm=0;
+    // Between the fans and the front walls when those are instanced
+    queueObject(after, LAYER_BALL, bullet, lerpValue(snap.prev_sx, snap.sx, alpha), lerpValue(snap.prev_sy, snap.sy, alpha),
+            instanced ? 0.2f : 0, lerpAngle(snap.prev_bullet_rotation, snap.bullet_rotation, alpha));
+
+    if (!instanced)
+        queueWalls(after, 1);
+
+    mergeCommands(buffers.data(), buffers.size(), renderqueue.commands);
+    sortCommands(renderqueue.commands, renderqueue.scratch);
+
+    // Everything streamed this frame is written before the first draw
+    beginRingFrame(streamring, transformBytes() + (instanced ? instances.moving*sizeof(glm::vec4) : 0));
+    bool streamed = uploadTransforms();
+    if (instanced && !updateInstances(snap, alpha))
+        streamed = false;
+    endRingWrites(streamring);
+    endZone(ZONE_BUILD, build);
+
+    // Without this frame's placements the draws would read another
+    // frame's, or nothing ever written
+    if (streamed) {
+        ProfileScope submit(ZONE_SUBMIT);
+        submitCommands();
     }
-
-
-    if(sy<=-5.9)
-    {
-        resetprojectile();
-        vx=ux+ax*t;
-        vy=uy+ay*t;
-        sy=-6+0.12;
-        uy=-(vy*(1.0))/4;
-        ux=vx*3/5;
-    }
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateBullet = glm::translate (glm::vec3(sx,sy , 0));        // glTranslatef
-    glm::mat4 rotateBullet = glm::rotate((float)(bullet_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-    Matrices.model *= ((translateBullet * rotateBullet));
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    draw3DObject(bullet);
-
-    float increments2 = 100;
-
-
-    //camera_rotation_angle++; // Simulating camera rotation
-    bullet_rotation = bullet_rotation + increments2; //*rectangle_rot_dir*rectangle_rot_status;
-
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    slab=slab+0.1;
-    glm::mat4 translateRectanglesideup = glm::translate (glm::vec3(0, 7.5, 0));        // glTranslatef
-    //STOPPING ROTATION OF RECTANGLE
-    Matrices.model *= (translateRectanglesideup);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    draw3DObject(rectanglesideup);
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateRectangleleft = glm::translate (glm::vec3(-11.6, 0, 0));        // glTranslatef
-    Matrices.model *= (translateRectangleleft);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    draw3DObject(rectangleleft);
-
-
-
-    Matrices.model = glm::mat4(1.0f);
-    //   slab=slab+0.1;
-    glm::mat4 translateRectangleright = glm::translate (glm::vec3(11.6, 0, 0));        // glTranslatef
-    //STOPPING ROTATION OF RECTANGLE
-    Matrices.model *= (translateRectangleright);// * rotateRectangle);
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    draw3DObject(rectangleright);
+    else
+        fprintf(stderr, "frame %ld: no stream ring space, draws skipped\n", frames);
+    endGpuTimer(gputimer);
+    endRingFrame(streamring);
+    frames++;
 }
 
 /* Initialise glfw window, I/O callbacks and the renderer to use */
@@ -1392,29 +1118,33 @@ GLFWwindow* initGLFW (int width, int height)
 void initGL (GLFWwindow* window, int width, int height)
 {
     /* Objects should be created before any other gl function and shaders */
+    resetGLState (statecache);
     // Create the models
-    createTriangle (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
-    createRectangle ();
+    createQuadIndices ();
+    createRing (streamring, 64*1024);
+    createGpuTimer (gputimer, ZONE_GPU);
+    if (instanced)
+        createInstances ();
+    else
+        createLevelObjects (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
     createCannon ();
-    createSquare1 ();
-    createSquare2 ();
-    createSquare3 ();
-    createSquare4 ();
-    createSquare5 ();
-    createRectangle1 ();
-    createRectangle2 ();
-    createRectangle3 ();
     createBullet();
-    createBarrier1();
-    createBarrier2();
-    createRectanglesideup();
-    createRectangleleft();
-    createRectangleright();
+
+    printf("meshes: %ld objects, %zu unique VAOs (registry hit rate %.1f%%)\n",
+            meshobjects, meshregistry.size(), 100.0*meshhits/meshobjects);
+    printf("mesh memory: %ld bytes packed (%.1f bytes/object), %ld bytes as float3 arrays (%.1f bytes/object)\n",
+            meshbytes, (double)meshbytes/meshobjects, meshbytes_unpacked, (double)meshbytes_unpacked/meshobjects);
 
     // Create and compile our GLSL program from the shaders
     programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-    // Get a handle for our "MVP" uniform
-    Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+    // Both programs read VP from the camera block
+    createTransforms ();
+    bindBlocks (programID);
+    if (instanced)
+        bindBlocks (instances.ProgramID);
+
+    // Fixed camera for 2D (ortho) in XY plane
+    Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0));
 
 
     reshapeWindow (window, width, height);
@@ -1430,40 +1160,343 @@ void initGL (GLFWwindow* window, int width, int height)
     cout << "RENDERER: " << glGetString(GL_RENDERER) << endl;
     cout << "VERSION: " << glGetString(GL_VERSION) << endl;
     cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+
+    // Count only what drawing frames costs
+    glstate.issued = glstate.elided = 0;
+}
+
+/* Golden-image scenes: fixed states of the world, each drawn once headless
+ * and held against a reference image DIR/NAME.ppm. The tolerance absorbs
+ * rounding differences between equivalent ways of drawing: small colour
+ * errors, and edges a pixel over (see diffImages()). Anything more, even
+ * the ball out of place, fails. */
+#define SCENE_TOLERANCE  2          // per channel
+#define SCENE_MAX_KNOCKS 32         // knocked-down scenes, for big levels
+#define SCENE_WIDTH      300        // small enough to keep the references
+#define SCENE_HEIGHT     200        // in the repository
+
+/* Draw the posed world and check it against DIR/name.ppm, or record it
+ * there. A render that fails is kept as DIR/name.fail.ppm. */
+bool checkScene (const char* dir, const char* name, bool record)
+{
+    draw();
+    int width = offscreen.width, height = offscreen.height;
+    std::vector<unsigned char> rgb(3*width*height);
+    readOffscreen(offscreen, rgb.data());
+    std::string path = std::string(dir) + "/" + name;
+    if (record)
+        return writePPM((path + ".ppm").c_str(), rgb.data(), width, height);
+
+    std::vector<unsigned char> ref;
+    int w = 0, h = 0, worst = 0;
+    long bad = -1;
+    if (readPPM((path + ".ppm").c_str(), ref, w, h) && w == width && h == height)
+        bad = diffImages(rgb.data(), ref.data(), width, height, SCENE_TOLERANCE, worst);
+    bool ok = bad == 0;
+    printf("%-14s %s", name, ok ? "ok  " : "FAIL");
+    if (bad >= 0)
+        printf("  %ld pixels off by more than %d, worst %d", bad, SCENE_TOLERANCE, worst);
+    printf("\n");
+    if (!ok)
+        writePPM((path + ".fail.ppm").c_str(), rgb.data(), width, height);
+    return ok;
+}
+
+/* Every scene in turn: the level as loaded, fans at set angles, zoomed
+ * out, the cannon raised, the ball in the air, then the targets knocked
+ * down one more at a time. Returns the number that failed. */
+int runScenes (const char* dir, bool record)
+{
+    int failed = 0, count = 0;
+    char name[32];
+
+    poseWorld(world, 0);
+    failed += !checkScene(dir, "initial", record); count++;
+
+    static const float angles[] = { 30, 90, 135 };
+    for (int i=0; i<3; i++) {
+        poseWorld(world, angles[i]);
+        snprintf(name, sizeof(name), "fans_%03.0f", angles[i]);
+        failed += !checkScene(dir, name, record); count++;
+    }
+    poseWorld(world, 0);
+
+    static const float zooms[] = { 0.9f, 0.5f };
+    for (int i=0; i<2; i++) {
+        zoom = zooms[i];
+        setProjection();
+        snprintf(name, sizeof(name), "zoom_%03.0f", zooms[i]*100);
+        failed += !checkScene(dir, name, record); count++;
+    }
+    zoom = 1;
+    setProjection();
+
+    // Reload after every turn of the cannon so the ball sits at its mouth
+    world.cannon_rotation = 45;
+    reloadCannon(world);
+    poseWorld(world, 0);
+    failed += !checkScene(dir, "cannon_45", record); count++;
+
+    world.sx = 0; world.sy = 2;
+    world.bullet_rotation = 45;
+    poseWorld(world, 0);
+    failed += !checkScene(dir, "ball_flight", record); count++;
+    world.cannon_rotation = 0;
+    reloadCannon(world);
+
+    int knocks = std::min((int)world.targets.size(), SCENE_MAX_KNOCKS);
+    for (int i=0; i<knocks; i++) {
+        knockDown(world, i);
+        poseWorld(world, 0);
+        snprintf(name, sizeof(name), "knocked_%02d", i+1);
+        failed += !checkScene(dir, name, record); count++;
+    }
+
+    if (record)
+        printf("scenes: %d recorded in %s%s\n", count - failed, dir, failed ? ", some could not be written" : "");
+    else
+        printf("scenes: %d of %d match %s\n", count - failed, count, dir);
+    return failed;
+}
+
+/* The benchmark's player, in cycles of BENCH_CYCLE frames: turn the
+ * cannon up or down for a quarter second, charge and fire with a charge
+ * that varies from shot to shot, and reload near the end of the cycle.
+ * Frame numbers are on the 60 Hz clock, so every run plays the same game. */
+#define BENCH_CYCLE 240
+
+void benchScript (int frame)
+{
+    int cycle = frame/BENCH_CYCLE, f = frame%BENCH_CYCLE;
+    int fire = 50 + 10*(cycle%4);
+    if (f == 0)
+        sendInput(sim, INPUT_TURN, cycle%2 ? -1 : 1);
+    else if (f == 15)
+        sendInput(sim, INPUT_TURN, 0);
+    else if (f == 20)
+        sendInput(sim, INPUT_CHARGE, 0);
+    else if (f == fire)
+        sendInput(sim, INPUT_FIRE, 0);
+    else if (f == BENCH_CYCLE-10)
+        sendInput(sim, INPUT_RELOAD, 0);
+}
+
+/* Draw n frames of the scripted game as fast as they go, in the window or
+ * headless, and report the frame rate, frame time percentiles, draw calls
+ * and simulation ticks. A frame's time runs from the end of the one
+ * before to the end of its swap and poll. */
+void runBench (GLFWwindow* window, const char* level_path, int n)
+{
+    std::vector<double> ms;
+    ms.reserve(n);
+    long calls = drawcalls;
+    long ticks = world.ticks;
+    double start = profileClock(), last = start;
+    for (int f=0; f<n; f++) {
+        if (window && glfwWindowShouldClose(window))
+            break;
+        benchScript(f);
+        headless_clock += 1.0/60;
+        draw();
+        if (capturing)
+            captureFrame(capture);
+        if (window) {
+            {
+                ProfileScope swap(ZONE_SWAP);
+                glfwSwapBuffers(window);
+            }
+            ProfileScope poll(ZONE_POLL);
+            glfwPollEvents();
+        }
+        double now = profileClock();
+        ms.push_back((now - last)*1000);
+        last = now;
+    }
+    // Headless nothing waits for the last frames to be drawn
+    glFinish();
+    double seconds = profileClock() - start;
+    if (ms.empty())
+        return;
+    ticks = world.ticks - ticks;
+
+    std::vector<double> sorted(ms);
+    std::sort(sorted.begin(), sorted.end());
+    size_t count = sorted.size();
+    const ZoneStats& update = zones[ZONE_UPDATE];
+
+    printf("bench: %s, %zu frames %s, %s renderer on %s\n", level_path, count,
+            headless ? "headless" : "windowed, vsync off", instanced ? "instanced" : "per-object",
+            (const char*)glGetString(GL_RENDERER));
+    printf("bench: %.1f fps average\n", count/seconds);
+    printf("bench: frame time ms: p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n", sortedPercentile(sorted, 50),
+            sortedPercentile(sorted, 95), sortedPercentile(sorted, 99), sorted[count-1]);
+    printf("bench: %.1f draw calls per frame\n", (double)(drawcalls - calls)/count);
+    printf("bench: %ld sim ticks, %.0f ticks/s run, %.0f ticks/s of update time\n", ticks, ticks/seconds,
+            update.total > 0 ? update.count/update.total*1000 : 0);
+    // Same on every run of the same build and level, as a check on the replay
+    printf("bench: score %d, %d targets left\n", world.flagscore, targetsLeft(world));
+}
+
+/* Announce the score when it has gone up past shown */
+void printScore (int& shown)
+{
+    int score = latestSnapshot(sim).flagscore;
+    if(score>shown)
+    {
+        printf("Score-update:%d\n",score);
+        shown=score;
+        if(score>WIN_SCORE)
+            printf("\nYOU WON!!\n");
+    }
 }
 
 int main (int argc, char** argv)
 {
-    float gravityvariable, airvar;
+    float gravityvariable, airvar, ax, ay;
+    double hz = SIM_HZ;
+    const char* level_path = NULL;
+    const char* trace_path = NULL;
+    const char* out_path = NULL;
+    const char* capture_path = NULL;
+    const char* scenes_dir = NULL;
+    bool record = false;
+    int frame_count = 600;
     int k=0;
     int width = 900;
     int height = 600;
-    printf("\n\n\n**********\nAbout the game: Shoot the cannon ball to destroy the building avoiding the obstacles.\n");
-    printf("Read the help.pdf file for RULES and CONTROLS.\n**********\n");
-    printf("\n\n");
-    printf("|Where would you like to play the game?|\n");
-    printf("|Input 1 for EARTH and 2 for MOON.|\n");
-    scanf("%f",&gravityvariable);
-    printf("\n");
-    printf("\n|What do you want the air-resistance to be?|\n");
-    printf("|Input 1 for LOW, 2 for MEDIUM and 3 for HIGH|\n");
-    scanf("%f",&airvar);
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--hz") && i+1<argc && atof(argv[i+1]) > 0)
+            hz = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--level") && i+1<argc)
+            level_path = argv[++i];
+        else if (!strcmp(argv[i], "--instanced"))
+            instanced = true;
+        else if (!strcmp(argv[i], "--no-state-cache"))
+            statecache = false;
+        else if (!strcmp(argv[i], "--record-threads") && i+1<argc && atoi(argv[i+1]) > 0)
+            recordthreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--sim-inline"))
+            siminline = true;
+        else if (!strcmp(argv[i], "--trace") && i+1<argc)
+            trace_path = argv[++i];
+        else if (!strcmp(argv[i], "--headless"))
+            headless = true;
+        else if (!strcmp(argv[i], "--frames") && i+1<argc && atoi(argv[i+1]) > 0)
+            frame_count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--out") && i+1<argc)
+            out_path = argv[++i];
+        else if (!strcmp(argv[i], "--capture") && i+1<argc)
+            capture_path = argv[++i];
+        else if (!strcmp(argv[i], "--scenes") && i+1<argc) {
+            scenes_dir = argv[++i];
+            headless = true;
+            width = SCENE_WIDTH;
+            height = SCENE_HEIGHT;
+        }
+        else if (!strcmp(argv[i], "--record"))
+            record = true;
+        else if (!strcmp(argv[i], "--bench") && i+1<argc) {
+            level_path = argv[++i];
+            benchmark = true;
+        }
+        else {
+            printf("Usage: %s [--hz SIMULATION_RATE] [--level FILE.lvl] [--instanced] [--no-state-cache] [--record-threads N] [--sim-inline]"
+                    " [--trace FILE.json] [--capture FILE.y4m|FRAME%%05d.ppm|FILE.mp4]\n"
+                    "       %s --headless [--frames N] [--out FILE.ppm] [same options]\n"
+                    "       %s --scenes DIR [--record] [same options]\n"
+                    "       %s --bench FILE.lvl [--frames N] [--headless] [same options]\n", argv[0], argv[0], argv[0], argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    if(gravityvariable==1)
-        ay=-15;
+    if (headless || benchmark)
+    {
+        // Nobody to ask: Earth, low air resistance, and the simulation
+        // stepped by the frames so the run is repeatable
+        gravityvariable=1;
+        airvar=1;
+        siminline=true;
+        sim.time_source=gameTime;
+    }
     else
-        ay=-5;
-    if(airvar==1)
-        ax=-1;
-    else if(airvar==2)
-        ax=-4;
-    else 
-        ax=-8;
+    {
+        printf("\n\n\n**********\nAbout the game: Shoot the cannon ball to destroy the building avoiding the obstacles.\n");
+        printf("Read the help.pdf file for RULES and CONTROLS.\n**********\n");
+        printf("\n\n");
+        printf("|Where would you like to play the game?|\n");
+        printf("|Input 1 for EARTH and 2 for MOON.|\n");
+        scanf("%f",&gravityvariable);
+        printf("\n");
+        printf("\n|What do you want the air-resistance to be?|\n");
+        printf("|Input 1 for LOW, 2 for MEDIUM and 3 for HIGH|\n");
+        scanf("%f",&airvar);
+    }
 
-    GLFWwindow* window = initGLFW(width, height);
+    ay=gravityPreset(gravityvariable);
+    ax=airPreset(airvar);
+
+    level = stockLevel();
+    if (level_path && !loadLevel(level_path, level))
+        exit(EXIT_FAILURE);
+    initWorld(world, level, ax, ay);
+    initSim(sim, world, hz);
+    profiling = true;
+    if (trace_path && !startTrace(trace_path))
+        exit(EXIT_FAILURE);
+    traceThreadName("render");
+
+    GLFWwindow* window = NULL;
+    if (headless) {
+        if (!createOffscreen(offscreen, width, height))
+            exit(EXIT_FAILURE);
+    }
+    else {
+        window = initGLFW(width, height);
+        if (benchmark)
+            glfwSwapInterval(0);
+    }
 
     initGL (window, width, height);
 
+    // Headless this is a replay export: frames are drawn as fast as they
+    // can be read back, on the fixed 60 Hz clock
+    if (capture_path) {
+        if (!startCapture(capture, capture_path, width, height, 60))
+            exit(EXIT_FAILURE);
+        capturing = true;
+    }
+
+    last_update_time = gameTime();
+    if (!siminline)
+        startSim(sim);
+
+    if (scenes_dir) {
+        int failed = runScenes(scenes_dir, record);
+        destroyOffscreen(offscreen);
+        exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    if (benchmark) {
+        runBench(window, level_path, frame_count);
+        quit(window);
+    }
+
+    if (headless) {
+        for (int f=0; f<frame_count; f++) {
+            headless_clock += 1.0/60;
+            draw();
+            if (capturing)
+                captureFrame(capture);
+            printScore(k);
+        }
+        if (out_path) {
+            std::vector<unsigned char> rgb(3*width*height);
+            readOffscreen(offscreen, rgb.data());
+            if (!writePPM(out_path, rgb.data(), width, height))
+                exit(EXIT_FAILURE);
+        }
+        quit(NULL);
+    }
 
 
     /* Draw in loop */
@@ -1471,25 +1504,26 @@ int main (int argc, char** argv)
 
         // OpenGL Draw commands
         draw();
-        if(flagscore>k)
-        {
-            printf("Score-update:%d\n",flagscore);
-            k=flagscore;
-            if(flagscore>90)
-                printf("\nYOU WON!!\n");
-        }
+        if (capturing)
+            captureFrame(capture);
+        printScore(k);
 
 
 
         // Swap Frame Buffer in double buffering
-        glfwSwapBuffers(window);
+        {
+            ProfileScope swap(ZONE_SWAP);
+            glfwSwapBuffers(window);
+        }
 
         // Poll for Keyboard and mouse events
-        glfwPollEvents();
+        {
+            ProfileScope poll(ZONE_POLL);
+            glfwPollEvents();
+        }
         glfwSetScrollCallback(window, scroll_callback);
 
     }
 
-    glfwTerminate();
-    exit(EXIT_SUCCESS);
+    quit(window);
 }
@@ -0,0 +1,28 @@
+#include "glstate.h"
+
+GLState glstate;
+
+void resetGLState (bool enabled)
+{
+    glstate = GLState();
+    glstate.enabled = enabled;
+
+    // Nothing real is ever bound with these, so each first call goes through
+    glstate.program = glstate.vertex_array = glstate.array_buffer = glstate.uniform_buffer = ~0u;
+    glstate.range_buffer[0] = glstate.range_buffer[1] = ~0u;
+    glstate.polygon_mode = 0;
+    glstate.object_index = -1;
+}
+
+void forgetBuffer (GLuint buffer)
+{
+    if (glstate.array_buffer == buffer)
+        glstate.array_buffer = 0;
+    if (glstate.uniform_buffer == buffer)
+        glstate.uniform_buffer = 0;
+    for (int i=0; i<2; i++)
+        if (glstate.range_buffer[i] == buffer) {
+            glstate.range_buffer[i] = 0;
+            glstate.range_offset[i] = 0;
+        }
+}
@@ -0,0 +1,100 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h>
+
+/* Shadow of the GL state the game changes while drawing.
+ * Every program, VAO, buffer and polygon mode change goes through the
+ * set*() calls below, which drop any call that would leave the state as it
+ * is. The shadow is only right if nothing calls those GL functions
+ * directly, so nothing outside this file should. With the cache off every
+ * call is passed on, for measuring what it saves. */
+struct GLState {
+    bool enabled;
+
+    GLuint program;
+    GLuint vertex_array;
+    GLenum polygon_mode;
+    GLuint array_buffer;
+    GLuint uniform_buffer;          // the generic GL_UNIFORM_BUFFER binding
+    GLuint range_buffer[2];         // indexed uniform bindings 0 and 1
+    GLintptr range_offset[2];
+    GLint object_index;             // current value of attribute 2
+
+    long issued, elided;            // calls passed on to GL, and dropped
+};
+
+extern GLState glstate;
+
+/* Forget what is bound, so the next call of each kind goes through, and
+ * zero the counts */
+void resetGLState (bool enabled);
+
+/* GL unbinds a deleted buffer from every binding it held: do the same to
+ * the shadow, so binding a new buffer given the same name goes through.
+ * Call with the name just deleted. */
+void forgetBuffer (GLuint buffer);
+
+#define GLSTATE_SAME(field, value) \
+    if (glstate.enabled && glstate.field == (value)) { glstate.elided++; return; } \
+    glstate.field = (value); glstate.issued++;
+
+inline void setProgram (GLuint program)
+{
+    GLSTATE_SAME(program, program)
+    glUseProgram(program);
+}
+
+inline void setVertexArray (GLuint vao)
+{
+    GLSTATE_SAME(vertex_array, vao)
+    glBindVertexArray(vao);
+}
+
+inline void setPolygonMode (GLenum mode)
+{
+    GLSTATE_SAME(polygon_mode, mode)
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+/* The element buffer binding belongs to the bound VAO, so it isn't
+ * shadowed; other targets than these aren't used */
+inline void setBuffer (GLenum target, GLuint buffer)
+{
+    if (target == GL_ARRAY_BUFFER) {
+        GLSTATE_SAME(array_buffer, buffer)
+    }
+    else if (target == GL_UNIFORM_BUFFER) {
+        GLSTATE_SAME(uniform_buffer, buffer)
+    }
+    else
+        glstate.issued++;
+    glBindBuffer(target, buffer);
+}
+
+/* Bind a range of buffer to uniform binding index (0 or 1); this also
+ * binds it to the generic GL_UNIFORM_BUFFER target */
+inline void setBufferRange (GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    if (glstate.enabled && glstate.range_buffer[index] == buffer && glstate.range_offset[index] == offset
+            && glstate.uniform_buffer == buffer) {
+        glstate.elided++;
+        return;
+    }
+    glstate.range_buffer[index] = buffer;
+    glstate.range_offset[index] = offset;
+    glstate.uniform_buffer = buffer;
+    glstate.issued++;
+    glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+}
+
+/* The per-draw object index, a constant integer attribute */
+inline void setObjectIndex (GLint index)
+{
+    GLSTATE_SAME(object_index, index)
+    glVertexAttribI1i(2, index);
+}
+
+#undef GLSTATE_SAME
+
+#endif
@@ -0,0 +1,40 @@
+#include "gputimer.h"
+#include "profile.h"
+
+void createGpuTimer (GpuTimer& t, int zone)
+{
+    glGenQueries(GPU_TIMER_LATENCY+1, t.query);
+    for (int i=0; i<=GPU_TIMER_LATENCY; i++)
+        t.pending[i] = false;
+    t.frame = 0;
+    t.zone = zone;
+    t.dropped = 0;
+}
+
+void beginGpuTimer (GpuTimer& t)
+{
+    if (!profiling)
+        return;
+    t.frame = (t.frame + 1) % (GPU_TIMER_LATENCY+1);
+    GLuint q = t.query[t.frame];
+    if (t.pending[t.frame]) {
+        GLint ready = 0;
+        glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &ready);
+        if (ready) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+            recordZone(t.zone, ns/1e6);
+        }
+        else
+            t.dropped++;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, q);
+}
+
+void endGpuTimer (GpuTimer& t)
+{
+    if (!profiling)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    t.pending[t.frame] = true;
+}
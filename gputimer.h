@@ -0,0 +1,27 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+/* GL_TIME_ELAPSED queries into a profile zone, read back GPU_TIMER_LATENCY
+ * frames after they were issued so reading never waits for the GPU. A
+ * result still not in by the time its query comes round again is dropped
+ * rather than waited for. Does nothing unless profiling is set. */
+#define GPU_TIMER_LATENCY 3
+
+struct GpuTimer {
+    GLuint query[GPU_TIMER_LATENCY+1];
+    bool pending[GPU_TIMER_LATENCY+1];
+    int frame;                  // query in use
+    int zone;
+    long dropped;               // results not ready in time
+};
+
+void createGpuTimer (GpuTimer& t, int zone);
+
+/* Start timing; reads back the oldest query first if its result is in */
+void beginGpuTimer (GpuTimer& t);
+
+void endGpuTimer (GpuTimer& t);
+
+#endif
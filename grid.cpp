@@ -0,0 +1,245 @@
+#include <cmath>
+#include <utility>
+
+#include "world.h"
+#include "grid.h"
+
+using namespace std;
+
+#define GRID_CELLS_PER_TARGET 4     // cap on cells per target before cells grow
+
+static int clampCell (int i, int n)
+{
+    return (i < 0) ? 0 : (i >= n) ? n-1 : i;
+}
+
+/* Cell range a target's hit box covers */
+static void cellRange (const TargetGrid& g, const Target& t, int& ix0, int& iy0, int& ix1, int& iy1)
+{
+    ix0 = clampCell((int)floor((t.x-t.hx-g.x0)/g.cell), g.nx);
+    ix1 = clampCell((int)floor((t.x+t.hx-g.x0)/g.cell), g.nx);
+    iy0 = clampCell((int)floor((t.y-t.hy-g.y0)/g.cell), g.ny);
+    iy1 = clampCell((int)floor((t.y+t.hy-g.y0)/g.cell), g.ny);
+}
+
+void buildGrid (TargetGrid& g, const vector<Target>& targets)
+{
+    int n = targets.size();
+    g.query = 0;
+    g.stamp.assign(n, 0);
+    if (n == 0) {
+        g.nx = g.ny = 0;
+        g.x0 = g.y0 = 0;
+        g.cell = 1;
+        g.start.assign(1, 0);
+        g.count.clear();
+        g.items.clear();
+        return;
+    }
+
+    // Cells about the size of an average block, grown if the level is so
+    // sparse that empty cells would dominate
+    float minx = targets[0].x-targets[0].hx, maxx = targets[0].x+targets[0].hx;
+    float miny = targets[0].y-targets[0].hy, maxy = targets[0].y+targets[0].hy;
+    double size = 0;
+    for (int i=0; i<n; i++) {
+        const Target& t = targets[i];
+        minx = fmin(minx, t.x-t.hx); maxx = fmax(maxx, t.x+t.hx);
+        miny = fmin(miny, t.y-t.hy); maxy = fmax(maxy, t.y+t.hy);
+        size += 2*fmax(t.hx, t.hy);
+    }
+    g.cell = fmax(size/n, 1e-3);
+    for (;;) {
+        g.nx = (int)ceil((maxx-minx)/g.cell) + 1;
+        g.ny = (int)ceil((maxy-miny)/g.cell) + 1;
+        if ((double)g.nx*g.ny <= (double)GRID_CELLS_PER_TARGET*n + 16)
+            break;
+        g.cell *= 1.5f;
+    }
+    g.x0 = minx;
+    g.y0 = miny;
+
+    // Count, prefix-sum, then fill
+    int cells = g.nx*g.ny;
+    g.start.assign(cells+1, 0);
+    g.count.assign(cells, 0);
+    int ix0, iy0, ix1, iy1;
+    for (int i=0; i<n; i++) {
+        cellRange(g, targets[i], ix0, iy0, ix1, iy1);
+        for (int iy=iy0; iy<=iy1; iy++)
+            for (int ix=ix0; ix<=ix1; ix++)
+                g.start[iy*g.nx + ix + 1]++;
+    }
+    for (int c=0; c<cells; c++)
+        g.start[c+1] += g.start[c];
+    g.items.resize(g.start[cells]);
+    for (int i=0; i<n; i++) {
+        if (targets[i].destroyed)
+            continue;
+        cellRange(g, targets[i], ix0, iy0, ix1, iy1);
+        for (int iy=iy0; iy<=iy1; iy++)
+            for (int ix=ix0; ix<=ix1; ix++) {
+                int c = iy*g.nx + ix;
+                g.items[g.start[c] + g.count[c]++] = i;
+            }
+    }
+}
+
+void removeFromGrid (TargetGrid& g, const vector<Target>& targets, int i)
+{
+    int ix0, iy0, ix1, iy1;
+    cellRange(g, targets[i], ix0, iy0, ix1, iy1);
+    for (int iy=iy0; iy<=iy1; iy++)
+        for (int ix=ix0; ix<=ix1; ix++) {
+            int c = iy*g.nx + ix;
+            int* slot = &g.items[g.start[c]];
+            for (int k=0; k<g.count[c]; k++)
+                if (slot[k] == i) {
+                    slot[k] = slot[--g.count[c]];
+                    break;
+                }
+        }
+}
+
+float segmentEntry (const Target& t, float x0, float y0, float dx, float dy)
+{
+    float lo = 0, hi = 1;
+    float p[2] = { x0, y0 }, d[2] = { dx, dy };
+    float c[2] = { t.x, t.y }, h[2] = { t.hx, t.hy };
+    for (int a=0; a<2; a++) {
+        if (d[a] == 0) {
+            if (abs(p[a]-c[a]) > h[a])
+                return -1;
+            continue;
+        }
+        float u0 = (c[a]-h[a]-p[a])/d[a], u1 = (c[a]+h[a]-p[a])/d[a];
+        if (u0 > u1)
+            swap(u0, u1);
+        lo = fmax(lo, u0);
+        hi = fmin(hi, u1);
+        if (lo > hi)
+            return -1;
+    }
+    return lo;
+}
+
+/* Called for each cell a segment crosses, in order, with the fraction
+ * along the segment where the next cell starts. Returns true to stop. */
+typedef bool (*CellVisit)(TargetGrid& g, int cell, float next, void* arg);
+
+/* Walk the cells the segment (x0,y0)-(x1,y1) crosses, starting a new query
+ * so each target can be stamped the first time a visit sees it */
+static void walkSegment (TargetGrid& g, float x0, float y0, float x1, float y1, CellVisit visit, void* arg)
+{
+    if (g.nx == 0)
+        return;
+    float dx = x1-x0, dy = y1-y0;
+
+    // Clip the segment to the grid
+    float gx1 = g.x0 + g.nx*g.cell, gy1 = g.y0 + g.ny*g.cell;
+    float ua = 0, ub = 1;
+    float p[2] = { x0, y0 }, d[2] = { dx, dy };
+    float lo[2] = { g.x0, g.y0 }, hi[2] = { gx1, gy1 };
+    for (int a=0; a<2; a++) {
+        if (d[a] == 0) {
+            if (p[a] < lo[a] || p[a] > hi[a])
+                return;
+            continue;
+        }
+        float u0 = (lo[a]-p[a])/d[a], u1 = (hi[a]-p[a])/d[a];
+        if (u0 > u1)
+            swap(u0, u1);
+        ua = fmax(ua, u0);
+        ub = fmin(ub, u1);
+        if (ua > ub)
+            return;
+    }
+
+    // Walk the cells the segment crosses in order (Amanatides-Woo)
+    int ix = clampCell((int)floor((x0 + ua*dx - g.x0)/g.cell), g.nx);
+    int iy = clampCell((int)floor((y0 + ua*dy - g.y0)/g.cell), g.ny);
+    int stepx = (dx > 0) ? 1 : -1, stepy = (dy > 0) ? 1 : -1;
+    float nextx = (dx != 0) ? (g.x0 + (ix + (dx > 0))*g.cell - x0)/dx : INFINITY;
+    float nexty = (dy != 0) ? (g.y0 + (iy + (dy > 0))*g.cell - y0)/dy : INFINITY;
+    float deltax = (dx != 0) ? g.cell/abs(dx) : INFINITY;
+    float deltay = (dy != 0) ? g.cell/abs(dy) : INFINITY;
+
+    // Boxes span cells, so the same target can turn up more than once
+    if (++g.query == 0) {
+        g.stamp.assign(g.stamp.size(), 0);
+        g.query = 1;
+    }
+    for (;;) {
+        float next = fmin(nextx, nexty);
+        if (visit(g, iy*g.nx + ix, next, arg) || next > ub)
+            break;
+        if (nextx < nexty) {
+            ix += stepx;
+            nextx += deltax;
+            if (ix < 0 || ix >= g.nx)
+                break;
+        }
+        else {
+            iy += stepy;
+            nexty += deltay;
+            if (iy < 0 || iy >= g.ny)
+                break;
+        }
+    }
+}
+
+struct SegmentQuery {
+    const vector<Target>* targets;
+    float x0, y0, dx, dy;
+    int best;                       // first hit so far, for gridFirstHit()
+    float u;
+    vector<int>* out;               // everything touched, for gridCollect()
+};
+
+static bool firstHitVisit (TargetGrid& g, int c, float next, void* arg)
+{
+    SegmentQuery& q = *(SegmentQuery*)arg;
+    const int* slot = &g.items[g.start[c]];
+    for (int k=0; k<g.count[c]; k++) {
+        int i = slot[k];
+        if (g.stamp[i] == g.query)
+            continue;
+        g.stamp[i] = g.query;
+        float e = segmentEntry((*q.targets)[i], q.x0, q.y0, q.dx, q.dy);
+        if (e >= 0 && e < q.u) {
+            q.u = e;
+            q.best = i;
+        }
+    }
+    // Anything hit so far is entered before the next cell starts
+    return q.u <= next;
+}
+
+int gridFirstHit (TargetGrid& g, const vector<Target>& targets, float x0, float y0, float x1, float y1, float& u)
+{
+    SegmentQuery q = { &targets, x0, y0, x1-x0, y1-y0, -1, 2, NULL };
+    walkSegment(g, x0, y0, x1, y1, firstHitVisit, &q);
+    u = q.u;
+    return q.best;
+}
+
+static bool collectVisit (TargetGrid& g, int c, float, void* arg)
+{
+    SegmentQuery& q = *(SegmentQuery*)arg;
+    const int* slot = &g.items[g.start[c]];
+    for (int k=0; k<g.count[c]; k++) {
+        int i = slot[k];
+        if (g.stamp[i] == g.query)
+            continue;
+        g.stamp[i] = g.query;
+        if (segmentEntry((*q.targets)[i], q.x0, q.y0, q.dx, q.dy) >= 0)
+            q.out->push_back(i);
+    }
+    return false;
+}
+
+void gridCollect (TargetGrid& g, const vector<Target>& boxes, float x0, float y0, float x1, float y1, vector<int>& out)
+{
+    SegmentQuery q = { &boxes, x0, y0, x1-x0, y1-y0, -1, 2, &out };
+    walkSegment(g, x0, y0, x1, y1, collectVisit, &q);
+}
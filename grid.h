@@ -0,0 +1,42 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <vector>
+
+struct Target;
+
+/* Uniform-grid broadphase over the targets' hit boxes.
+ * Every box is listed in each cell it overlaps, cells packed one after
+ * another in items. A destroyed target is swapped out of its cells, so
+ * queries only ever see standing ones. */
+struct TargetGrid {
+    float x0, y0;                   // lower-left corner
+    float cell;                     // cell edge length
+    int nx, ny;
+    std::vector<int> start;         // first slot of each cell in items
+    std::vector<int> count;         // standing targets in each cell
+    std::vector<int> items;         // target indices, grouped by cell
+    std::vector<unsigned> stamp;    // per target, last query that looked at it
+    unsigned query;
+};
+
+/* Size the grid to the targets' bounds and insert every standing one */
+void buildGrid (TargetGrid& g, const std::vector<Target>& targets);
+
+/* Drop target i from every cell it was in */
+void removeFromGrid (TargetGrid& g, const std::vector<Target>& targets, int i);
+
+/* Slab test: fraction along the segment (x0,y0)+u*(dx,dy), 0<=u<=1, where
+ * it enters the box, or -1 if it misses */
+float segmentEntry (const Target& t, float x0, float y0, float dx, float dy);
+
+/* First standing target whose hit box the segment (x0,y0)-(x1,y1) enters,
+ * visiting only the cells the segment crosses, in order. Returns its index
+ * and the fraction u along the segment, or -1. */
+int gridFirstHit (TargetGrid& g, const std::vector<Target>& targets, float x0, float y0, float x1, float y1, float& u);
+
+/* Every standing box the segment touches, appended to out in the order
+ * its cells are crossed. Also serves the fans, with their reach as boxes. */
+void gridCollect (TargetGrid& g, const std::vector<Target>& boxes, float x0, float y0, float x1, float y1, std::vector<int>& out);
+
+#endif
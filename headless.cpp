@@ -0,0 +1,93 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#include "world.h"
+#include "level.h"
+
+using namespace std;
+
+/* Headless simulation throughput benchmark.
+ * Fires shots over the stock level, or the one given with --level, without a
+ * window or GL context and reports how many simulation ticks run per
+ * millisecond, and how long the level took to load. */
+
+static void usage (const char* prog)
+{
+    printf("Usage: %s [--ticks N] [--dt SECONDS] [--gravity 1|2] [--air 1|2|3] [--level FILE.lvl]\n", prog);
+}
+
+int main (int argc, char** argv)
+{
+    long ticks = 10000000;
+    float dt = 1.0f/240;
+    int gravityvariable = 1, airvar = 1;
+    const char* level_path = NULL;
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--ticks") && i+1<argc)
+            ticks = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--dt") && i+1<argc)
+            dt = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--gravity") && i+1<argc)
+            gravityvariable = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--air") && i+1<argc)
+            airvar = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--level") && i+1<argc)
+            level_path = argv[++i];
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    float ay = gravityPreset(gravityvariable);
+    float ax = airPreset(airvar);
+
+    // Mapping the file and copying the targets out is the whole load
+    auto load_start = chrono::steady_clock::now();
+    Level level = stockLevel();
+    if (level_path && !loadLevel(level_path, level))
+        return EXIT_FAILURE;
+    World world;
+    initWorld(world, level, ax, ay);
+    double load_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - load_start).count();
+
+    long shots = 0, done = 0, total_score = 0;
+    int angle_step = 0;
+    double shot_start = 0;
+    auto start = chrono::steady_clock::now();
+    while (done < ticks) {
+        if (!world.in_flight) {
+            // Walk through the cannon range with a spread of charges
+            world.cannon_rotation = CANNON_MIN + (angle_step*7)%(int)(CANNON_MAX-CANNON_MIN);
+            fireCannon(world, 0.5 + 0.25*(angle_step%8));
+            angle_step++;
+            shots++;
+            shot_start = world.time;
+        }
+        updateWorld(world, dt);
+        done++;
+        if (shotFinished(world) || world.time - shot_start > 30) {
+            // Rebuild the level once everything has been knocked down
+            if (targetsLeft(world) == 0) {
+                total_score += world.flagscore;
+                initWorld(world, level, ax, ay);
+            }
+            else
+                reloadCannon(world);
+        }
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    printf("objects: %d (%zu targets, %zu fans)\n", level.count, world.targets.size(), world.barriers.size());
+    printf("level load: %.3f ms\n", load_ms);
+    printf("ticks: %ld\n", done);
+    printf("shots: %ld\n", shots);
+    printf("score: %ld\n", total_score + world.flagscore);
+    printf("elapsed: %.3f ms\n", ms);
+    printf("ticks/ms: %.1f\n", done/ms);
+    unloadLevel(level);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "level.h"
+
+using namespace std;
+
+static_assert(sizeof(LevelHeader) == 16, "LevelHeader must match the file layout");
+static_assert(sizeof(LevelObject) == 64, "LevelObject must match the file layout");
+
+bool loadLevel (const char* path, Level& level)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    if (size < sizeof(LevelHeader)) {
+        fprintf(stderr, "%s: not a level file\n", path);
+        close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+
+    // Only the header is checked; records are read where they are
+    const LevelHeader* h = (const LevelHeader*)map;
+    const char* why = NULL;
+    if (h->magic != LEVEL_MAGIC)
+        why = "not a level file";
+    else if (h->version != LEVEL_VERSION)
+        why = "unsupported level version";
+    else if (h->record_size != sizeof(LevelObject))
+        why = "wrong record size";
+    else if (size != sizeof(LevelHeader) + (size_t)h->count*sizeof(LevelObject))
+        why = "truncated or padded";
+    if (why) {
+        fprintf(stderr, "%s: %s\n", path, why);
+        munmap(map, size);
+        return false;
+    }
+
+    level.objects = (const LevelObject*)(h+1);
+    level.count = h->count;
+    level.map = map;
+    level.map_size = size;
+    return true;
+}
+
+void unloadLevel (Level& level)
+{
+    if (level.map)
+        munmap(level.map, level.map_size);
+    level.objects = NULL;
+    level.count = 0;
+    level.map = NULL;
+    level.map_size = 0;
+}
+
+bool writeLevel (const char* path, const LevelObject* objects, int count)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    LevelHeader h = { LEVEL_MAGIC, LEVEL_VERSION, (uint32_t)count, sizeof(LevelObject) };
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+           && fwrite(objects, sizeof(LevelObject), count, f) == (size_t)count;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        perror(path);
+    return ok;
+}
+
+/* Text format: one object per line, '#' to end of line is a comment.
+ *
+ *   target SHAPE LAYER X Y LEFT BOTTOM RIGHT TOP R G B HX HY SIDE_X TOP_Y SCORE SPIN BOUNCE_BOTH
+ *   fan    SHAPE LAYER X Y LEFT BOTTOM RIGHT TOP R G B HW HH SPIN
+ *   wall   SHAPE LAYER X Y LEFT BOTTOM RIGHT TOP R G B
+ *
+ * SHAPE is quad or triangle. */
+
+static const char* kind_names[] = { "target", "fan", "wall" };
+static const char* shape_names[] = { "quad", "triangle" };
+
+static int lookup (const char* word, const char** names, int n)
+{
+    for (int i=0; i<n; i++)
+        if (!strcmp(word, names[i]))
+            return i;
+    return -1;
+}
+
+bool readLevelText (FILE* f, const char* name, vector<LevelObject>& objects)
+{
+    char line[1024];
+    for (int lineno=1; fgets(line, sizeof(line), f); lineno++) {
+        char* hash = strchr(line, '#');
+        if (hash)
+            *hash = 0;
+        char kind[16] = "", shape[16] = "";
+        int layer = 0, used = 0;
+        LevelObject o;
+        memset(&o, 0, sizeof(o));
+        int n = sscanf(line, " %15s", kind);
+        if (n != 1)
+            continue;               // blank or comment
+
+        n = sscanf(line, " %15s %15s %d %f %f %f %f %f %f %f %f %f%n", kind, shape, &layer,
+                &o.x, &o.y, &o.left, &o.bottom, &o.right, &o.top, &o.r, &o.g, &o.b, &used);
+        int k = lookup(kind, kind_names, 3), s = lookup(shape, shape_names, 2);
+        if (k < 0 || s < 0 || n != 12 || layer < 0 || layer > 1) {
+            fprintf(stderr, "%s:%d: bad object\n", name, lineno);
+            return false;
+        }
+        o.kind = k;
+        o.shape = s;
+        o.layer = layer;
+
+        const char* rest = line + used;
+        int extra = 0, bounce = 0;
+        if (k == LEVEL_TARGET)
+            n = sscanf(rest, "%f %f %f %f %d %f %d %n", &o.hx, &o.hy, &o.side_x, &o.top_y, &o.score, &o.spin, &bounce, &extra) - 7;
+        else if (k == LEVEL_BARRIER)
+            n = sscanf(rest, "%f %f %f %n", &o.hx, &o.hy, &o.spin, &extra) - 3;
+        else
+            n = sscanf(rest, " %n", &extra);
+        if (n != 0 || rest[extra]) {
+            fprintf(stderr, "%s:%d: wrong fields for a %s\n", name, lineno, kind);
+            return false;
+        }
+        if (bounce)
+            o.flags |= LEVEL_BOUNCE_BOTH;
+        objects.push_back(o);
+    }
+    return true;
+}
+
+/* Shortest form that reads back as the same float */
+static void putFloat (FILE* f, float v)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%g", v);
+    if (strtof(buf, NULL) != v)
+        snprintf(buf, sizeof(buf), "%.9g", v);
+    fprintf(f, " %s", buf);
+}
+
+void writeLevelText (FILE* f, const LevelObject* objects, int count)
+{
+    fprintf(f, "# target SHAPE LAYER X Y LEFT BOTTOM RIGHT TOP R G B HX HY SIDE_X TOP_Y SCORE SPIN BOUNCE_BOTH\n");
+    fprintf(f, "# fan    SHAPE LAYER X Y LEFT BOTTOM RIGHT TOP R G B HW HH SPIN\n");
+    fprintf(f, "# wall   SHAPE LAYER X Y LEFT BOTTOM RIGHT TOP R G B\n");
+    for (int i=0; i<count; i++) {
+        const LevelObject& o = objects[i];
+        if (o.kind > LEVEL_WALL || o.shape > LEVEL_TRIANGLE) {
+            fprintf(f, "# record %d: unknown kind %d shape %d\n", i, o.kind, o.shape);
+            continue;
+        }
+        fprintf(f, "%-6s %-8s %d ", kind_names[o.kind], shape_names[o.shape], o.layer);
+        float common[] = { o.x, o.y, o.left, o.bottom, o.right, o.top, o.r, o.g, o.b };
+        for (int j=0; j<9; j++)
+            putFloat(f, common[j]);
+        if (o.kind == LEVEL_TARGET) {
+            float hit[] = { o.hx, o.hy, o.side_x, o.top_y };
+            for (int j=0; j<4; j++)
+                putFloat(f, hit[j]);
+            fprintf(f, " %d", o.score);
+            putFloat(f, o.spin);
+            fprintf(f, " %d", (o.flags & LEVEL_BOUNCE_BOTH) ? 1 : 0);
+        }
+        else if (o.kind == LEVEL_BARRIER) {
+            putFloat(f, o.hx);
+            putFloat(f, o.hy);
+            putFloat(f, o.spin);
+        }
+        fprintf(f, "\n");
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/* Binary level format.
+ * A .lvl file is a LevelHeader followed directly by count LevelObject
+ * records, little-endian, exactly as these structs lay out in memory. It is
+ * mmap'd and the records are used where they sit: nothing is parsed or
+ * allocated per object. The text files in levels/ are the authoring format;
+ * levelc converts between the two. */
+
+#define LEVEL_MAGIC   0x4c564c47u   // "GLVL"
+#define LEVEL_VERSION 1
+
+enum LevelKind { LEVEL_TARGET, LEVEL_BARRIER, LEVEL_WALL };
+enum LevelShape { LEVEL_QUAD, LEVEL_TRIANGLE };
+
+#define LEVEL_BOUNCE_BOTH 1         // flags: target reflects both velocity components
+
+struct LevelHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;                 // number of records
+    uint32_t record_size;           // sizeof(LevelObject), as a sanity check
+};
+
+struct LevelObject {
+    uint8_t kind;                   // LevelKind
+    uint8_t shape;                  // LevelShape; a triangle's apex is top centre
+    uint8_t layer;                  // 0 drawn behind the ball, 1 in front
+    uint8_t flags;
+    int32_t score;                  // targets
+    float x, y;                     // centre, or pivot for fans
+    float left, bottom, right, top; // drawn extent about (x, y)
+    float hx, hy;                   // hit box (targets) or blade (fans) half extents
+    float side_x, top_y;            // targets: bounce off the side/top past these
+    float spin;                     // degrees/sec
+    float r, g, b;
+};
+
+/* A level's records, mapped from a file or compiled in */
+struct Level {
+    const LevelObject* objects;
+    int count;
+    void* map;                      // mmap'd file, NULL if compiled in
+    size_t map_size;
+};
+
+/* Map a .lvl file. Prints why and returns false if it is not one. */
+bool loadLevel (const char* path, Level& level);
+
+/* Unmap a level loaded with loadLevel() */
+void unloadLevel (Level& level);
+
+/* The original layout, compiled in from levels/level1.txt (stocklevel.cpp) */
+const Level& stockLevel ();
+
+/* Write records as a .lvl file */
+bool writeLevel (const char* path, const LevelObject* objects, int count);
+
+/* Read and write the text authoring format. Errors name the line. */
+bool readLevelText (FILE* f, const char* name, std::vector<LevelObject>& objects);
+void writeLevelText (FILE* f, const LevelObject* objects, int count);
+
+#endif
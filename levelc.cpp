@@ -0,0 +1,95 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "level.h"
+
+using namespace std;
+
+/* Level converter.
+ * Compiles the text authoring format into the binary .lvl the game maps,
+ * prints a .lvl back as text, or turns a text level into the initializer
+ * stocklevel.cpp compiles in, so levels/level1.txt is the only copy. */
+
+static void usage (const char* prog)
+{
+    printf("Usage: %s IN.txt OUT.lvl     compile a text level\n"
+           "       %s --dump IN.lvl      print a level as text\n"
+           "       %s --cpp IN.txt OUT   write a text level as a LevelObject initializer\n", prog, prog, prog);
+}
+
+/* A float literal that reads back as the same float */
+static void putLiteral (FILE* f, float v)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%g", v);
+    if (strtof(buf, NULL) != v)
+        snprintf(buf, sizeof(buf), "%.9g", v);
+    if (!strpbrk(buf, ".e"))
+        strcat(buf, ".0");
+    fprintf(f, " %sf", buf);
+}
+
+static bool writeInitializer (const char* path, const char* source, const vector<LevelObject>& objects)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    fprintf(f, "// Generated from %s by levelc --cpp; edit that file instead\n", source);
+    for (size_t i=0; i<objects.size(); i++) {
+        const LevelObject& o = objects[i];
+        fprintf(f, "{ %d, %d, %d, %d, %d,", o.kind, o.shape, o.layer, o.flags, o.score);
+        float rest[] = { o.x, o.y, o.left, o.bottom, o.right, o.top, o.hx, o.hy,
+                         o.side_x, o.top_y, o.spin, o.r, o.g, o.b };
+        for (int j=0; j<14; j++) {
+            putLiteral(f, rest[j]);
+            fprintf(f, j < 13 ? "," : " },\n");
+        }
+    }
+    bool ok = !ferror(f);
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        perror(path);
+    return ok;
+}
+
+int main (int argc, char** argv)
+{
+    bool cpp = argc > 1 && !strcmp(argv[1], "--cpp");
+    if (argc != (cpp ? 4 : 3)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!strcmp(argv[1], "--dump")) {
+        Level level;
+        if (!loadLevel(argv[2], level))
+            return EXIT_FAILURE;
+        writeLevelText(stdout, level.objects, level.count);
+        unloadLevel(level);
+        return EXIT_SUCCESS;
+    }
+
+    const char* in = argv[cpp ? 2 : 1];
+    const char* out = argv[cpp ? 3 : 2];
+    FILE* f = fopen(in, "r");
+    if (!f) {
+        perror(in);
+        return EXIT_FAILURE;
+    }
+    vector<LevelObject> objects;
+    bool ok = readLevelText(f, in, objects);
+    fclose(f);
+    if (!ok)
+        return EXIT_FAILURE;
+    if (cpp)
+        return writeInitializer(out, in, objects) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (!writeLevel(out, objects.data(), objects.size()))
+        return EXIT_FAILURE;
+    printf("%s: %zu objects\n", out, objects.size());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+#include "world.h"
+#include "level.h"
+
+using namespace std;
+
+/* Stress-level generator.
+ * Writes a level of exactly --objects objects: the four arena walls, then
+ * fans, floating ledges and brick buildings in the proportions asked for.
+ * Object sizes shrink with the count so everything fits the arena the
+ * cannon can reach. The layout depends only on the seed: the generator has
+ * its own PRNG and only uses exactly rounded float arithmetic, so the same
+ * seed gives the same file on any machine. The checksum it prints is over
+ * the records, for comparing runs. */
+
+/* splitmix64 */
+struct Rng {
+    uint64_t state;
+};
+
+static uint64_t next (Rng& r)
+{
+    uint64_t z = (r.state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [lo, hi) */
+static float uniform (Rng& r, float lo, float hi)
+{
+    return lo + (hi-lo)*(float)(next(r) >> 40)*(1.0f/16777216);
+}
+
+/* Uniform in lo..hi inclusive */
+static int pick (Rng& r, int lo, int hi)
+{
+    return lo + (int)(next(r) % (uint64_t)(hi-lo+1));
+}
+
+// Where the buildings and fans go: right of the cannon, between the ground
+// and the top wall, inside the side walls
+#define CITY_LEFT    -5.0f
+#define CITY_RIGHT   ARENA_HALF_WIDTH
+#define FAN_LEFT     -7.0f
+#define FAN_RIGHT    -2.0f
+#define FLOOR_Y      -6.0f      // top of the ground
+#define CEILING_Y     7.2f      // bottom of the top wall
+
+static LevelObject makeObject (int kind, float x, float y, float hw, float hh, float r, float g, float b)
+{
+    LevelObject o;
+    memset(&o, 0, sizeof(o));
+    o.kind = kind;
+    o.shape = LEVEL_QUAD;
+    o.x = x; o.y = y;
+    o.left = -hw; o.bottom = -hh;
+    o.right = hw; o.top = hh;
+    o.r = r; o.g = g; o.b = b;
+    return o;
+}
+
+/* The ground, top and side walls of level 1 */
+static void addFrame (vector<LevelObject>& out)
+{
+    const float red[] = { 0.97f, 0.3f, 0.3f };
+    LevelObject walls[] = {
+        makeObject(LEVEL_WALL, 0, -7, 12, 1, red[0], red[1], red[2]),
+        makeObject(LEVEL_WALL, 0, 7.6f, 12, 0.4f, red[0], red[1], red[2]),
+        makeObject(LEVEL_WALL, -11.6f, 0, 0.4f, 8, red[0], red[1], red[2]),
+        makeObject(LEVEL_WALL, 11.6f, 0, 0.4f, 8, red[0], red[1], red[2]),
+    };
+    for (int i=1; i<4; i++)
+        walls[i].layer = 1;
+    out.insert(out.end(), walls, walls+4);
+}
+
+/* Fans on a jittered grid left of the city, each within its own cell */
+static void addFans (vector<LevelObject>& out, Rng& rng, int n)
+{
+    if (n == 0)
+        return;
+    float w = FAN_RIGHT-FAN_LEFT, h = CEILING_Y-FLOOR_Y;
+    int cols = (int)ceil(sqrt(n*w/h));
+    int rows = (n + cols-1)/cols;
+    float cw = w/cols, ch = h/rows;
+    float reach = 0.45f*fmin(cw, ch);
+    for (int i=0; i<n; i++) {
+        float cx = FAN_LEFT + (i%cols + 0.5f)*cw;
+        float cy = FLOOR_Y + (i/cols + 0.5f)*ch;
+        float hh = reach*uniform(rng, 0.6f, 1);
+        LevelObject o = makeObject(LEVEL_BARRIER, cx + uniform(rng, -0.5f, 0.5f)*(cw-2*hh),
+                cy + uniform(rng, -0.5f, 0.5f)*(ch-2*hh), hh/10, hh, 0.4f, 0.8f, 0);
+        o.hx = o.right;
+        o.hy = o.top;
+        o.spin = uniform(rng, 60, 240)*(pick(rng, 0, 1) ? 1 : -1);
+        out.push_back(o);
+    }
+}
+
+/* Scenery slabs scattered over the whole arena, behind everything else */
+static void addLedges (vector<LevelObject>& out, Rng& rng, int n)
+{
+    float area = (2*ARENA_HALF_WIDTH)*(CEILING_Y-FLOOR_Y);
+    float hw = fmin(1.5f, 0.5f*sqrt(area/fmax(n, 1)));
+    for (int i=0; i<n; i++) {
+        float w = hw*uniform(rng, 0.5f, 1);
+        float shade = uniform(rng, 0.45f, 0.6f);
+        out.push_back(makeObject(LEVEL_WALL, uniform(rng, -ARENA_HALF_WIDTH+w, ARENA_HALF_WIDTH-w),
+                uniform(rng, FLOOR_Y+w, CEILING_Y-w), w, w/5, shade, shade, shade));
+    }
+}
+
+/* Buildings of 2:1 bricks standing on the ground. Bricks are sized so the
+ * city has about twice as many slots as bricks; each building is a run of
+ * columns with a random height, and any bricks left over are stacked onto
+ * columns from the left, so the count comes out exact. A column
+ * taller than both its neighbours gets a triangular roof brick. */
+static void addBuildings (vector<LevelObject>& out, Rng& rng, int n)
+{
+    if (n == 0)
+        return;
+    float w = CITY_RIGHT-CITY_LEFT, h = CEILING_Y-FLOOR_Y;
+    float bh = sqrt(w*h/(4.0f*n));
+    int cols = (int)fmax(1, floor(w/(2*bh)));
+    int rows = (int)fmax(1, floor(h/bh));
+    while ((long)cols*rows < n) {
+        bh *= 0.95f;
+        cols = (int)fmax(1, floor(w/(2*bh)));
+        rows = (int)fmax(1, floor(h/bh));
+    }
+    float bw = w/cols;
+
+    // Heights per column: buildings with one-column gaps, then top up
+    // from the left until every brick is placed
+    vector<int> height(cols, 0);
+    int placed = 0;
+    for (int c=0; c<cols && placed<n; ) {
+        int width = pick(rng, 2, 6);
+        int floors = pick(rng, 1, rows);
+        for (int k=0; k<width && c<cols; k++, c++) {
+            height[c] = min(floors, n-placed);
+            placed += height[c];
+        }
+        c++;
+    }
+    for (int c=0; placed<n; c = (c+1)%cols) {
+        int more = min(rows-height[c], n-placed);
+        height[c] += more;
+        placed += more;
+    }
+
+    for (int c=0; c<cols; c++) {
+        float r = 1, g = uniform(rng, 0.75f, 1), b = uniform(rng, 0, 0.2f);
+        for (int k=0; k<height[c]; k++) {
+            float x = CITY_LEFT + (c + 0.5f)*bw, y = FLOOR_Y + (k + 0.5f)*bh;
+            LevelObject o = makeObject(LEVEL_TARGET, x, y, 0.45f*bw, 0.45f*bh, r, g*(1 - 0.02f*(k%8)), b);
+            if (k == height[c]-1 && (c == 0 || height[c-1] < height[c]) && (c+1 == cols || height[c+1] < height[c]))
+                o.shape = LEVEL_TRIANGLE;
+            o.hx = 0.5f*bw;
+            o.hy = 0.5f*bh;
+            o.side_x = x + o.left;
+            o.top_y = y + o.top;
+            o.score = pick(rng, 1, 10);
+            out.push_back(o);
+        }
+    }
+}
+
+/* FNV-1a over the records */
+static uint64_t checksum (const vector<LevelObject>& objects)
+{
+    const unsigned char* p = (const unsigned char*)objects.data();
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i=0; i<objects.size()*sizeof(LevelObject); i++)
+        hash = (hash ^ p[i])*0x100000001b3ull;
+    return hash;
+}
+
+static void usage (const char* prog)
+{
+    printf("Usage: %s --objects N [--seed N] [--fans FRACTION] [--ledges FRACTION] [--out FILE.lvl|FILE.txt]\n", prog);
+}
+
+int main (int argc, char** argv)
+{
+    long objects = 0;
+    uint64_t seed = 1;
+    double fans = 0.01, ledges = 0.01;
+    const char* path = "stress.lvl";
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--objects") && i+1<argc)
+            objects = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i+1<argc)
+            seed = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--fans") && i+1<argc)
+            fans = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--ledges") && i+1<argc)
+            ledges = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--out") && i+1<argc)
+            path = argv[++i];
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (objects < 4 || objects > INT32_MAX || fans < 0 || ledges < 0 || fans+ledges > 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // At least one of anything asked for, however small the level
+    long rest = objects - 4;
+    long num_fans = min(rest, max((long)(fans > 0), (long)(rest*fans)));
+    long num_ledges = min(rest-num_fans, max((long)(ledges > 0), (long)(rest*ledges)));
+    long num_bricks = rest - num_fans - num_ledges;
+
+    // Each part draws from its own stream, so changing one proportion
+    // leaves the others' layout alone
+    Rng fan_rng = { seed*4 + 1 }, ledge_rng = { seed*4 + 2 }, city_rng = { seed*4 + 3 };
+    vector<LevelObject> out;
+    out.reserve(objects);
+    addFrame(out);
+    addLedges(out, ledge_rng, num_ledges);
+    addBuildings(out, city_rng, num_bricks);
+    addFans(out, fan_rng, num_fans);
+
+    size_t len = strlen(path);
+    if (len > 4 && !strcmp(path+len-4, ".txt")) {
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+        fprintf(f, "# levelgen --objects %ld --seed %llu --fans %g --ledges %g\n", objects,
+                (unsigned long long)seed, fans, ledges);
+        writeLevelText(f, out.data(), out.size());
+        fclose(f);
+    }
+    else if (!writeLevel(path, out.data(), out.size()))
+        return EXIT_FAILURE;
+
+    printf("%s: %zu objects (%ld bricks, %ld fans, %ld ledges, 4 walls), seed %llu, checksum %016llx\n",
+            path, out.size(), num_bricks, num_fans, num_ledges, (unsigned long long)seed,
+            (unsigned long long)checksum(out));
+    return EXIT_SUCCESS;
+}
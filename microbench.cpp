@@ -0,0 +1,466 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "world.h"
+#include "projectiles.h"
+#include "glstate.h"
+#include "offscreen.h"
+
+using namespace std;
+
+/* Hot path microbenchmarks.
+ * Times the per-tick and per-frame paths one at a time, each at object
+ * counts from 100 up to --max in steps of 10:
+ *
+ *   aabb_draw       the old per-block hit test from draw(), every block
+ *   aabb_grid       the same query through the target grid
+ *   barrier_sweep   checkcollisionbarrier(): a swept test per fan
+ *   projectile      one step of the projectile batch
+ *   aim_tick        updateWorld() while aiming: cannonanglecheck() and
+ *                   spinning every object
+ *   matrix_compose  the old per-object VP * translate * rotate in glm
+ *   placement_pack  the x, y, z, angle vec4 the render queue uploads instead
+ *   mesh_upload     create3DObject()'s VAO and VBO upload, in a headless
+ *                   GL context, up to --max-uploads objects
+ *
+ * Each case runs for at least --min-time seconds. Results print as a table
+ * and, with --json, are written in Google Benchmark's JSON layout so the
+ * usual comparison scripts read them. */
+
+// Results are summed into this so no loop can be optimised away
+volatile float sink;
+
+struct Result {
+    string name;            // case/count
+    int count;
+    long iterations;
+    double ns, cpu_ns;      // wall and CPU time per iteration
+    double items;           // processed per iteration
+};
+
+static vector<Result> results;
+
+typedef void (*Body)(void* arg);
+
+/* Run body until min_time seconds have passed in one timed batch, growing
+ * the batch as Google Benchmark does. Returns wall seconds per iteration;
+ * cpu gets the process CPU seconds per iteration. */
+static double timeBody (Body body, void* arg, double min_time, long& iterations, double& cpu)
+{
+    iterations = 1;
+    for (;;) {
+        clock_t cpu_start = clock();
+        auto start = chrono::steady_clock::now();
+        for (long i=0; i<iterations; i++)
+            body(arg);
+        double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cpu = (double)(clock() - cpu_start)/CLOCKS_PER_SEC/iterations;
+        if (s >= min_time || iterations >= (1L << 30))
+            return s/iterations;
+        double grow = s > min_time/100 ? 1.4*min_time/s : 100;
+        iterations = (long)fmax(iterations*2, iterations*grow);
+    }
+}
+
+static void record (const char* name, int count, long iterations, double seconds, double cpu, double items)
+{
+    Result r = { string(name) + "/" + to_string(count), count, iterations, seconds*1e9, cpu*1e9, items };
+    results.push_back(r);
+    printf("%-24s %10ld iterations %14.1f ns %10.2f ns/item\n", r.name.c_str(), iterations, r.ns, r.ns/items);
+    fflush(stdout);
+}
+
+static void bench (const char* name, int count, Body body, void* arg, double items, double min_time)
+{
+    long iterations;
+    double cpu;
+    double s = timeBody(body, arg, min_time, iterations, cpu);
+    record(name, count, iterations, s, cpu, items);
+}
+
+/* About one brick per square unit, however many there are */
+static vector<Target> randomBricks (int n)
+{
+    float side = sqrt((float)n);
+    vector<Target> targets(n);
+    for (int i=0; i<n; i++) {
+        Target& t = targets[i];
+        memset(&t, 0, sizeof(t));
+        t.x = side*rand()/RAND_MAX;
+        t.y = side*rand()/RAND_MAX;
+        t.hx = 0.1f + 0.2f*rand()/RAND_MAX;
+        t.hy = 0.1f + 0.2f*rand()/RAND_MAX;
+        t.score = 1;
+    }
+    return targets;
+}
+
+#define PATHS 64
+
+struct Path {
+    float x0, y0, x1, y1;
+};
+
+/* One tick's travel at 60 units/s from anywhere in a square of side */
+static void randomPaths (Path* paths, float side, float dt)
+{
+    for (int i=0; i<PATHS; i++) {
+        float h = 2*M_PI*rand()/RAND_MAX;
+        paths[i].x0 = side*rand()/RAND_MAX;
+        paths[i].y0 = side*rand()/RAND_MAX;
+        paths[i].x1 = paths[i].x0 + 60*dt*cos(h);
+        paths[i].y1 = paths[i].y0 + 60*dt*sin(h);
+    }
+}
+
+struct Blocks {
+    vector<Target> targets;
+    TargetGrid grid;
+    Path paths[PATHS];
+};
+
+/* What draw() did for each block every frame */
+static void aabbDraw (void* arg)
+{
+    Blocks& b = *(Blocks*)arg;
+    int hits = 0;
+    for (int q=0; q<PATHS; q++)
+        for (size_t i=0; i<b.targets.size(); i++) {
+            const Target& t = b.targets[i];
+            hits += !t.destroyed && abs(b.paths[q].x1-t.x) <= t.hx && abs(b.paths[q].y1-t.y) <= t.hy;
+        }
+    sink += hits;
+}
+
+static void aabbGrid (void* arg)
+{
+    Blocks& b = *(Blocks*)arg;
+    int hits = 0;
+    float u;
+    for (int q=0; q<PATHS; q++)
+        hits += gridFirstHit(b.grid, b.targets, b.paths[q].x0, b.paths[q].y0, b.paths[q].x1, b.paths[q].y1, u) >= 0;
+    sink += hits;
+}
+
+struct Fans {
+    vector<Barrier> fans;
+    Path paths[PATHS];
+    float dt;
+};
+
+/* checkcollisionbarrier() without the bounce, so every fan is tested */
+static void barrierSweep (void* arg)
+{
+    Fans& f = *(Fans*)arg;
+    int hits = 0;
+    Contact c;
+    for (int q=0; q<PATHS; q++)
+        for (size_t i=0; i<f.fans.size(); i++)
+            hits += sweepBarrier(f.fans[i], f.paths[q].x0, f.paths[q].y0, f.paths[q].x1, f.paths[q].y1, f.dt, c);
+    sink += hits;
+}
+
+struct Batch {
+    ProjectileBatch b;
+    float dt;
+};
+
+static void projectileStep (void* arg)
+{
+    Batch& p = *(Batch*)arg;
+    stepProjectiles(p.b, p.dt);
+    sink += p.b.sx[0];
+}
+
+struct Aim {
+    World w;
+    float dt;
+};
+
+/* A tick between shots, swinging the cannon end to end */
+static void aimTick (void* arg)
+{
+    Aim& a = *(Aim*)arg;
+    if (a.w.cannon_rotation >= CANNON_MAX)
+        a.w.cannonrotflag = -1;
+    else if (a.w.cannon_rotation <= CANNON_MIN)
+        a.w.cannonrotflag = 1;
+    updateWorld(a.w, a.dt);
+    sink += a.w.cannon_rotation;
+}
+
+struct Placements {
+    vector<glm::vec4> in;       // x, y, z, angle in degrees
+    vector<glm::mat4> mvp;
+    vector<glm::vec4> packed;
+    glm::mat4 VP;
+};
+
+static void matrixCompose (void* arg)
+{
+    Placements& p = *(Placements*)arg;
+    for (size_t i=0; i<p.in.size(); i++) {
+        glm::mat4 model = glm::translate(glm::vec3(p.in[i].x, p.in[i].y, p.in[i].z))
+                        * glm::rotate((float)(p.in[i].w*M_PI/180.0f), glm::vec3(0,0,1));
+        p.mvp[i] = p.VP * model;
+    }
+    sink += p.mvp[0][3][0];
+}
+
+static void placementPack (void* arg)
+{
+    Placements& p = *(Placements*)arg;
+    for (size_t i=0; i<p.in.size(); i++)
+        p.packed[i] = glm::vec4(p.in[i].x, p.in[i].y, p.in[i].z, p.in[i].w);
+    sink += p.packed[0].x;
+}
+
+/* Half-float x, y and RGBA8 colour, as create3DObject() packs a vertex */
+struct PackedVertex {
+    GLhalf x, y;
+    GLubyte r, g, b, a;
+};
+
+static const GLushort quad_indices[] = { 0, 1, 2, 2, 3, 0 };
+
+/* create3DObject()'s upload of n distinct quads: a VAO, a vertex buffer
+ * and the attribute layout each, drawing through one shared index buffer.
+ * Only creating them is timed, up to glFinish(); deleting them is not. */
+static void benchUpload (int n, double min_time)
+{
+    vector<PackedVertex> vertices(4*n);
+    for (int i=0; i<4*n; i++) {
+        PackedVertex v = { (GLhalf)(0x3c00 | (i & 0x3ff)), (GLhalf)(0x3c00 | ((i >> 10) & 0x3ff)),
+                           (GLubyte)i, (GLubyte)(i >> 8), (GLubyte)(i >> 16), 255 };
+        vertices[i] = v;
+    }
+    GLuint indices;
+    glGenBuffers(1, &indices);
+    setBuffer(GL_ARRAY_BUFFER, indices);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad_indices), quad_indices, GL_STATIC_DRAW);
+
+    vector<GLuint> vaos(n), vbos(n);
+    long iterations = 0;
+    double seconds = 0, cpu = 0;
+    while (seconds < min_time) {
+        clock_t cpu_start = clock();
+        auto start = chrono::steady_clock::now();
+        for (int i=0; i<n; i++) {
+            glGenVertexArrays(1, &vaos[i]);
+            glGenBuffers(1, &vbos[i]);
+            setVertexArray(vaos[i]);
+            setBuffer(GL_ARRAY_BUFFER, vbos[i]);
+            glBufferData(GL_ARRAY_BUFFER, 4*sizeof(PackedVertex), &vertices[4*i], GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)0);
+            glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, r));
+            glEnableVertexAttribArray(0);
+            glEnableVertexAttribArray(1);
+            setBuffer(GL_ELEMENT_ARRAY_BUFFER, indices);
+        }
+        glFinish();
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cpu += (double)(clock() - cpu_start)/CLOCKS_PER_SEC;
+        iterations++;
+
+        setVertexArray(0);
+        glDeleteVertexArrays(n, vaos.data());
+        glDeleteBuffers(n, vbos.data());
+        resetGLState(true);
+    }
+    glDeleteBuffers(1, &indices);
+    record("mesh_upload", n, iterations, seconds/iterations, cpu/iterations, n);
+}
+
+/* A JSON string, escaping what the label or renderer name might hold */
+static void putString (FILE* f, const char* s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*s >= ' ')
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+/* Google Benchmark's layout: a context object and one entry per case */
+static bool writeJSON (const char* path, const char* label, const char* renderer)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char date[64];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    fprintf(f, "{\n  \"context\": {\n");
+    fprintf(f, "    \"date\": \"%s\",\n", date);
+    fprintf(f, "    \"executable\": \"microbench\",\n");
+    fprintf(f, "    \"label\": ");
+    putString(f, label);
+    fprintf(f, ",\n");
+    fprintf(f, "    \"projectile_kernel\": \"%s\",\n", projectileKernelName());
+    fprintf(f, "    \"gl_renderer\": ");
+    putString(f, renderer);
+    fprintf(f, ",\n");
+    fprintf(f, "    \"library_build_type\": \"release\"\n  },\n");
+    fprintf(f, "  \"benchmarks\": [\n");
+    for (size_t i=0; i<results.size(); i++) {
+        const Result& r = results[i];
+        fprintf(f, "    {\n");
+        fprintf(f, "      \"name\": \"%s\",\n", r.name.c_str());
+        fprintf(f, "      \"run_type\": \"iteration\",\n");
+        fprintf(f, "      \"objects\": %d,\n", r.count);
+        fprintf(f, "      \"iterations\": %ld,\n", r.iterations);
+        fprintf(f, "      \"real_time\": %.3f,\n", r.ns);
+        fprintf(f, "      \"cpu_time\": %.3f,\n", r.cpu_ns);
+        fprintf(f, "      \"time_unit\": \"ns\",\n");
+        fprintf(f, "      \"items_per_second\": %.6g\n", r.items/r.ns*1e9);
+        fprintf(f, "    }%s\n", i+1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    bool ok = !ferror(f);
+    if (fclose(f) != 0 || !ok) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+static void usage (const char* prog)
+{
+    printf("Usage: %s [--max N] [--max-uploads N] [--min-time SECONDS] [--json FILE] [--label TEXT]\n", prog);
+}
+
+int main (int argc, char** argv)
+{
+    int max = 1000000, max_uploads = 10000;
+    double min_time = 0.2;
+    const char* json = NULL;
+    const char* label = "";
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--max") && i+1<argc)
+            max = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--max-uploads") && i+1<argc)
+            max_uploads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--min-time") && i+1<argc)
+            min_time = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--json") && i+1<argc)
+            json = argv[++i];
+        else if (!strcmp(argv[i], "--label") && i+1<argc)
+            label = argv[++i];
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (max < 100 || min_time <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    float dt = 1.0f/SIM_HZ;
+    float ax = airPreset(1), ay = gravityPreset(1);
+    World stock;
+    initWorld(stock, ax, ay);
+
+    srand(1);
+    for (int n=100; n<=max; n*=10) {
+        Blocks* blocks = new Blocks;
+        blocks->targets = randomBricks(n);
+        buildGrid(blocks->grid, blocks->targets);
+        randomPaths(blocks->paths, sqrt((float)n), dt);
+        bench("aabb_draw", n, aabbDraw, blocks, (double)PATHS*n, min_time);
+        bench("aabb_grid", n, aabbGrid, blocks, PATHS, min_time);
+        delete blocks;
+
+        // Stock fans on a grid of pivots three blade lengths apart, at
+        // every angle
+        Fans* fans = new Fans;
+        fans->dt = dt;
+        int side = (int)ceil(sqrt((float)n));
+        float spacing = 3*barrierReach(stock.barriers[0]);
+        for (int i=0; i<n; i++) {
+            Barrier b = stock.barriers[i%2];
+            b.x = spacing*(i%side);
+            b.y = spacing*(i/side);
+            b.prev_rotation = 360.0f*rand()/RAND_MAX;
+            b.prev_cos = cos(b.prev_rotation*M_PI/180.0f);
+            b.prev_sin = sin(b.prev_rotation*M_PI/180.0f);
+            b.rotation = b.prev_rotation + b.spin*dt;
+            b.cos_rot = cos(b.rotation*M_PI/180.0f);
+            b.sin_rot = sin(b.rotation*M_PI/180.0f);
+            fans->fans.push_back(b);
+        }
+        randomPaths(fans->paths, spacing*side, dt);
+        bench("barrier_sweep", n, barrierSweep, fans, (double)PATHS*n, min_time);
+        delete fans;
+
+        Batch* batch = new Batch;
+        batch->dt = dt;
+        initProjectiles(batch->b, n, ax, ay);
+        for (int i=0; i<n; i++)
+            launchProjectile(batch->b, i, CANNON_MIN + (CANNON_MAX-CANNON_MIN)*(i%121)/120, 0.1 + 2.9*(i%97)/96, 2);
+        bench("projectile", n, projectileStep, batch, n, min_time);
+        delete batch;
+
+        // Level 1 with its spinning block repeated until there are n
+        // objects. A tick turns only the targets listed as spinning, so
+        // every copy is listed: all but level 1's static blocks turn.
+        Aim* aim = new Aim;
+        aim->dt = dt;
+        aim->w = stock;
+        aim->w.targets.resize(n - stock.barriers.size(), stock.targets[5]);
+        for (size_t i=stock.targets.size(); i<aim->w.targets.size(); i++)
+            aim->w.spinning.push_back(i);
+        aim->w.standing = aim->w.targets.size();
+        aim->w.cannonrotflag = 1;
+        bench("aim_tick", n, aimTick, aim, n, min_time);
+        delete aim;
+
+        Placements* p = new Placements;
+        p->VP = glm::ortho(-12.0f, 12.0f, -8.0f, 8.0f, 0.1f, 500.0f)
+              * glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0));
+        for (int i=0; i<n; i++)
+            p->in.push_back(glm::vec4(24.0f*rand()/RAND_MAX - 12, 16.0f*rand()/RAND_MAX - 8, 0, 360.0f*rand()/RAND_MAX));
+        p->mvp.resize(n);
+        p->packed.resize(n);
+        bench("matrix_compose", n, matrixCompose, p, n, min_time);
+        bench("placement_pack", n, placementPack, p, n, min_time);
+        delete p;
+    }
+
+    // Uploads need a context; without one the CPU cases still stand
+    Offscreen offscreen;
+    const char* renderer = "none";
+    if (max_uploads >= 100 && createOffscreen(offscreen, 64, 64)) {
+        resetGLState(true);
+        renderer = (const char*)glGetString(GL_RENDERER);
+        for (int n=100; n<=max_uploads; n*=10)
+            benchUpload(n, min_time);
+    }
+    else if (max_uploads >= 100)
+        fprintf(stderr, "no GL context, skipping mesh_upload\n");
+
+    bool ok = !json || writeJSON(json, label, renderer);
+    if (strcmp(renderer, "none"))
+        destroyOffscreen(offscreen);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
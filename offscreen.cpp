@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "offscreen.h"
+
+using namespace std;
+
+static bool hasExtension (const char* list, const char* name)
+{
+    size_t n = strlen(name);
+    for (const char* p = list; p && (p = strstr(p, name)); p += n)
+        if ((p == list || p[-1] == ' ') && (p[n] == ' ' || p[n] == 0))
+            return true;
+    return false;
+}
+
+/* Mesa's surfaceless platform needs nothing running; otherwise whatever
+ * the default display is */
+static EGLDisplay openDisplay ()
+{
+    const char* client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay && hasExtension(client, "EGL_MESA_platform_surfaceless")) {
+        EGLDisplay d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (d != EGL_NO_DISPLAY && eglInitialize(d, NULL, NULL))
+            return d;
+    }
+    EGLDisplay d = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (d != EGL_NO_DISPLAY && eglInitialize(d, NULL, NULL))
+        return d;
+    return EGL_NO_DISPLAY;
+}
+
+bool createOffscreen (Offscreen& o, int width, int height)
+{
+    o.width = width;
+    o.height = height;
+    o.surface = EGL_NO_SURFACE;
+    o.context = EGL_NO_CONTEXT;
+    EGLDisplay display = openDisplay();
+    o.display = display;
+    if (display == EGL_NO_DISPLAY) {
+        fprintf(stderr, "offscreen: no EGL display\n");
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "offscreen: EGL has no desktop GL\n");
+        return false;
+    }
+
+    // A context with no surface if the display allows it, else one with
+    // a pbuffer config and a token 1x1 pbuffer to make it current on
+    const char* ext = eglQueryString(display, EGL_EXTENSIONS);
+    bool surfaceless = hasExtension(ext, "EGL_KHR_surfaceless_context");
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!surfaceless || !hasExtension(ext, "EGL_KHR_no_config_context")) {
+        const EGLint want[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLint found = 0;
+        if (!eglChooseConfig(display, want, &config, 1, &found) || found == 0) {
+            fprintf(stderr, "offscreen: no EGL config for desktop GL\n");
+            return false;
+        }
+    }
+    const EGLint attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    o.context = eglCreateContext(display, config, EGL_NO_CONTEXT, attribs);
+    if (o.context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "offscreen: can't create a GL 3.3 core context (EGL error 0x%x)\n", eglGetError());
+        return false;
+    }
+    if (!surfaceless) {
+        const EGLint size[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        o.surface = eglCreatePbufferSurface(display, config, size);
+    }
+    if (!eglMakeCurrent(display, o.surface, o.surface, o.context)) {
+        fprintf(stderr, "offscreen: can't make the context current (EGL error 0x%x)\n", eglGetError());
+        return false;
+    }
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        fprintf(stderr, "offscreen: can't load GL\n");
+        return false;
+    }
+
+    glGenRenderbuffers(1, &o.color);
+    glBindRenderbuffer(GL_RENDERBUFFER, o.color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &o.depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, o.depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glGenFramebuffers(1, &o.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, o.framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, o.color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, o.depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "offscreen: framebuffer incomplete\n");
+        return false;
+    }
+    printf("offscreen: %dx%d framebuffer, EGL %s\n", width, height,
+            surfaceless ? "surfaceless context" : "pbuffer context");
+    return true;
+}
+
+void readOffscreen (const Offscreen& o, unsigned char* rgb)
+{
+    // GL's rows run bottom up
+    vector<unsigned char> rows(3*o.width*o.height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, o.framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, o.width, o.height, GL_RGB, GL_UNSIGNED_BYTE, rows.data());
+    size_t stride = 3*o.width;
+    for (int y=0; y<o.height; y++)
+        memcpy(rgb + y*stride, rows.data() + (o.height-1-y)*stride, stride);
+}
+
+bool writePPM (const char* path, const unsigned char* rgb, int width, int height)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    bool ok = fwrite(rgb, 3*width, height, f) == (size_t)height;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        perror(path);
+    return ok;
+}
+
+bool readPPM (const char* path, vector<unsigned char>& rgb, int& width, int& height)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    int maxval = 0;
+    bool ok = fscanf(f, "P6 %d %d %d", &width, &height, &maxval) == 3 && fgetc(f) != EOF
+           && width > 0 && height > 0 && maxval == 255;
+    if (ok) {
+        rgb.resize(3*(size_t)width*height);
+        ok = fread(rgb.data(), rgb.size(), 1, f) == 1;
+    }
+    fclose(f);
+    if (!ok)
+        fprintf(stderr, "%s: not an 8-bit binary PPM\n", path);
+    return ok;
+}
+
+long diffImages (const unsigned char* a, const unsigned char* b, int width, int height, int tolerance, int& worst)
+{
+    vector<char> off((size_t)width*height);
+    worst = 0;
+    for (size_t i=0; i<off.size(); i++) {
+        int d = 0;
+        for (int k=0; k<3; k++)
+            d = max(d, abs(a[3*i+k] - b[3*i+k]));
+        worst = max(worst, d);
+        off[i] = d > tolerance;
+    }
+    // Count a pixel only if the difference spreads both across and down
+    long bad = 0;
+    for (int y=0; y<height; y++)
+        for (int x=0; x<width; x++) {
+            const char* p = &off[(size_t)y*width + x];
+            if (*p && ((x > 0 && p[-1]) || (x+1 < width && p[1]))
+                   && ((y > 0 && p[-width]) || (y+1 < height && p[width])))
+                bad++;
+        }
+    return bad;
+}
+
+void destroyOffscreen (Offscreen& o)
+{
+    if (o.display == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(o.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (o.surface != EGL_NO_SURFACE)
+        eglDestroySurface(o.display, o.surface);
+    if (o.context != EGL_NO_CONTEXT)
+        eglDestroyContext(o.display, o.context);
+    eglTerminate(o.display);
+    o.display = EGL_NO_DISPLAY;
+}
@@ -0,0 +1,48 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <vector>
+
+#include <glad/glad.h>
+
+/* Headless rendering.
+ * A GL 3.3 core context made through EGL with no window system: on Mesa's
+ * surfaceless platform where there is one (llvmpipe on a machine with no
+ * GPU or display), else the default display. The context needs no surface
+ * of its own; everything is drawn into a framebuffer object of the given
+ * size, bound in place of the window's. */
+
+// EGL handles are kept as void* so the EGL headers, which can pull in
+// Xlib, stay out of the game's translation unit
+struct Offscreen {
+    void* display;
+    void* context;
+    void* surface;              // 1x1 pbuffer, or none if surfaceless
+    GLuint framebuffer;
+    GLuint color, depth;        // RGBA8 and 24-bit depth renderbuffers
+    int width, height;
+};
+
+/* Make the context current, load GL through glad and bind the framebuffer.
+ * Prints why and returns false if any step fails. */
+bool createOffscreen (Offscreen& o, int width, int height);
+
+/* The framebuffer as width*height RGB bytes, top row first. Waits for the
+ * frame to finish. */
+void readOffscreen (const Offscreen& o, unsigned char* rgb);
+
+/* Binary PPM of width*height RGB bytes, top row first */
+bool writePPM (const char* path, const unsigned char* rgb, int width, int height);
+
+/* Read a binary PPM as written above. Prints why and returns false if it
+ * can't. */
+bool readPPM (const char* path, std::vector<unsigned char>& rgb, int& width, int& height);
+
+/* Pixels of two width x height RGB images that differ by more than
+ * tolerance in any channel, leaving out differences only one pixel thick
+ * (an edge rasterized a pixel over); worst is set to the largest difference */
+long diffImages (const unsigned char* a, const unsigned char* b, int width, int height, int tolerance, int& worst);
+
+void destroyOffscreen (Offscreen& o);
+
+#endif
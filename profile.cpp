@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profile.h"
+
+using namespace std;
+
+bool profiling = false;
+bool tracing = false;
+ZoneStats zones[NUM_ZONES];
+
+static const char* zone_names[NUM_ZONES] = { "update", "collision", "build", "submit", "swap", "poll", "draw", "gpu" };
+
+const char* zoneName (int zone)
+{
+    return zone_names[zone];
+}
+
+double profileClock ()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void recordZone (int zone, double ms)
+{
+    ZoneStats& z = zones[zone];
+    z.samples[z.count % PROFILE_WINDOW] = ms;
+    z.count++;
+    z.total += ms;
+}
+
+/* Nearest rank */
+double sortedPercentile (const vector<double>& sorted, double p)
+{
+    size_t n = sorted.size();
+    if (n == 0)
+        return 0;
+    size_t rank = (size_t)(p/100*n + 0.999999);
+    return sorted[rank == 0 ? 0 : min(rank, n) - 1];
+}
+
+double zonePercentile (const ZoneStats& z, double p)
+{
+    vector<double> sorted(z.samples, z.samples + min(z.count, (long)PROFILE_WINDOW));
+    sort(sorted.begin(), sorted.end());
+    return sortedPercentile(sorted, p);
+}
+
+void printProfile (FILE* f)
+{
+    fprintf(f, "%-10s %9s %9s %9s %9s %9s   (ms; percentiles over the last %d)\n",
+            "zone", "samples", "mean", "p50", "p95", "p99", PROFILE_WINDOW);
+    for (int i=0; i<NUM_ZONES; i++) {
+        const ZoneStats& z = zones[i];
+        if (z.count == 0)
+            continue;
+        fprintf(f, "%-10s %9ld %9.3f %9.3f %9.3f %9.3f\n", zone_names[i], z.count, z.total/z.count,
+                zonePercentile(z, 50), zonePercentile(z, 95), zonePercentile(z, 99));
+    }
+}
+
+/* Tracing. A thread's ring is made on its first event and written only by
+ * that thread; the writer thread is its only reader. When the thread exits
+ * its ring is marked retired, and freed once drained. */
+
+#define TRACE_DRAIN_MS 5            // writer's sleep between drains
+
+struct TraceRecord {
+    double time;
+    const char* name;
+    char phase;                 // 'B', 'E', or 'M' to name the thread
+};
+
+struct TraceRing {
+    TraceRecord events[TRACE_RING_EVENTS];
+    atomic<unsigned> head;      // next to write out; written by the writer
+    atomic<unsigned> tail;      // next to log; written by the owner
+    atomic<bool> retired;
+    int tid;
+    long dropped;               // events lost to a full ring
+};
+
+struct TraceOwner {
+    TraceRing* ring;
+    ~TraceOwner () { if (ring) ring->retired.store(true, memory_order_release); }
+};
+
+static thread_local TraceOwner trace_owner;
+static mutex trace_lock;            // guards the list of rings, not their contents
+static vector<TraceRing*> trace_rings;
+static int trace_threads;
+static FILE* trace_file;
+static double trace_start;
+static long trace_written, trace_dropped;
+static thread trace_writer;
+static atomic<bool> trace_running;
+
+static TraceRing* threadRing ()
+{
+    TraceRing*& r = trace_owner.ring;
+    if (!r) {
+        r = new TraceRing();
+        lock_guard<mutex> hold(trace_lock);
+        r->tid = ++trace_threads;
+        trace_rings.push_back(r);
+    }
+    return r;
+}
+
+void traceEvent (const char* name, char phase)
+{
+    TraceRing* r = threadRing();
+    unsigned tail = r->tail.load(memory_order_relaxed);
+    if (tail - r->head.load(memory_order_acquire) == TRACE_RING_EVENTS) {
+        r->dropped++;
+        return;
+    }
+    TraceRecord& e = r->events[tail % TRACE_RING_EVENTS];
+    e.time = profileClock();
+    e.name = name;
+    e.phase = phase;
+    r->tail.store(tail + 1, memory_order_release);
+}
+
+void traceThreadName (const char* name)
+{
+    if (tracing)
+        traceEvent(name, 'M');
+}
+
+static void writeRecord (const TraceRecord& e, int tid)
+{
+    fputs(trace_written ? ",\n" : "[\n", trace_file);
+    if (e.phase == 'M')
+        fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                tid, e.name);
+    else {
+        // Microseconds to the nanosecond, without printf's float formatting
+        long long ns = (long long)((e.time - trace_start)*1e9 + 0.5);
+        fprintf(trace_file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld.%03lld,\"pid\":1,\"tid\":%d}",
+                e.name, e.phase, ns/1000, ns%1000, tid);
+    }
+    trace_written++;
+}
+
+/* Write out everything logged so far */
+static void drainRings ()
+{
+    lock_guard<mutex> hold(trace_lock);
+    for (size_t i=0; i<trace_rings.size(); ) {
+        TraceRing* r = trace_rings[i];
+        bool retired = r->retired.load(memory_order_acquire);
+        unsigned head = r->head.load(memory_order_relaxed);
+        unsigned tail = r->tail.load(memory_order_acquire);
+        for (; head != tail; head++)
+            writeRecord(r->events[head % TRACE_RING_EVENTS], r->tid);
+        r->head.store(head, memory_order_release);
+        if (retired) {
+            trace_dropped += r->dropped;
+            delete r;
+            trace_rings[i] = trace_rings.back();
+            trace_rings.pop_back();
+        }
+        else
+            i++;
+    }
+}
+
+static void writeLoop ()
+{
+    while (trace_running.load(memory_order_relaxed)) {
+        drainRings();
+        this_thread::sleep_for(chrono::milliseconds(TRACE_DRAIN_MS));
+    }
+    drainRings();
+}
+
+bool startTrace (const char* path)
+{
+    trace_file = fopen(path, "w");
+    if (!trace_file) {
+        perror(path);
+        return false;
+    }
+    trace_start = profileClock();
+    trace_written = trace_dropped = 0;
+    trace_running = true;
+    trace_writer = thread(writeLoop);
+    tracing = true;
+    return true;
+}
+
+void stopTrace ()
+{
+    if (!trace_file)
+        return;
+    tracing = false;
+    trace_running = false;
+    trace_writer.join();
+    for (size_t i=0; i<trace_rings.size(); i++)
+        trace_dropped += trace_rings[i]->dropped;
+    fputs(trace_written ? "\n]\n" : "[]\n", trace_file);
+    fclose(trace_file);
+    trace_file = NULL;
+    printf("trace: %ld events written, %ld dropped on a full ring\n", trace_written, trace_dropped);
+}
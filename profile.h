@@ -0,0 +1,103 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdio>
+#include <vector>
+
+/* Frame timing.
+ * Each zone keeps its last PROFILE_WINDOW samples, in milliseconds, for
+ * rolling percentiles, and a count and total over the whole run. A zone is
+ * only ever written from one thread (the simulation's or the renderer's),
+ * so recording takes no lock; read the figures once both have stopped.
+ * Nothing is recorded until profiling is set, so the tools that link the
+ * simulation pay one branch per zone.
+ *
+ * With tracing set, zones and any other named spans are also logged as
+ * begin/end events for a timeline: each thread appends to its own lock-free
+ * ring, a few nanoseconds an event, and a writer thread of the trace's own
+ * drains them all into a Chrome trace JSON file, which Perfetto and
+ * chrome://tracing open. Formatting the JSON never runs on a traced thread. */
+
+enum ProfileZoneId {
+    ZONE_UPDATE,        // one simulation tick
+    ZONE_COLLISION,     // its collision tests
+    ZONE_BUILD,         // recording, sorting and streaming the frame's draws
+    ZONE_SUBMIT,        // issuing them
+    ZONE_SWAP,          // glfwSwapBuffers
+    ZONE_POLL,          // glfwPollEvents
+    ZONE_DRAW,          // the whole of draw()
+    ZONE_GPU,           // GPU time of the frame's draws, from timer queries
+    NUM_ZONES
+};
+
+#define PROFILE_WINDOW 1024
+
+struct ZoneStats {
+    double samples[PROFILE_WINDOW];     // ms, the newest count % PROFILE_WINDOW back
+    long count;
+    double total;
+};
+
+extern bool profiling, tracing;
+extern ZoneStats zones[NUM_ZONES];
+
+/* Seconds on a monotonic clock */
+double profileClock ();
+
+/* Add a sample of ms milliseconds to a zone */
+void recordZone (int zone, double ms);
+
+/* Log the start or end of a span on the calling thread's trace ring.
+ * name must outlive the trace (a string literal). */
+void traceEvent (const char* name, char phase);
+
+/* Name the calling thread in the trace */
+void traceThreadName (const char* name);
+
+/* Zone name, for the summary and the trace */
+const char* zoneName (int zone);
+
+/* A zone that isn't a whole scope: t = beginZone(zone); ... endZone(zone, t) */
+inline double beginZone (int zone)
+{
+    if (tracing)
+        traceEvent(zoneName(zone), 'B');
+    return profiling ? profileClock() : 0;
+}
+
+inline void endZone (int zone, double start)
+{
+    if (profiling)
+        recordZone(zone, (profileClock() - start)*1000);
+    if (tracing)
+        traceEvent(zoneName(zone), 'E');
+}
+
+/* Times the enclosing scope into a zone */
+struct ProfileScope {
+    int zone;
+    double start;
+    ProfileScope (int z) : zone(z), start(beginZone(z)) {}
+    ~ProfileScope () { endZone(zone, start); }
+};
+
+/* The p-th percentile (0..100) of a zone's window, in ms */
+double zonePercentile (const ZoneStats& z, double p);
+
+/* The p-th percentile (0..100) of samples sorted ascending, by nearest
+ * rank; 0 if there are none */
+double sortedPercentile (const std::vector<double>& sorted, double p);
+
+/* Samples, mean and p50/p95/p99 of every zone that has any */
+void printProfile (FILE* f);
+
+#define TRACE_RING_EVENTS 65536     // per thread, power of two
+
+/* Start the writer streaming the trace to path and set tracing */
+bool startTrace (const char* path);
+
+/* Clear tracing, write out the rest, finish the file and print how many
+ * events it holds */
+void stopTrace ();
+
+#endif
@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+
+#include "world.h"
+#include "projectiles.h"
+
+using namespace std;
+
+/* Projectile integrator microbenchmark.
+ * Launches a batch of balls across the cannon range, steps it with the
+ * scalar kernel and with the SIMD kernel, and reports projectile-steps per
+ * second for each along with the largest difference between the two. */
+
+static void launchAll (ProjectileBatch& b, int n, float ax, float ay)
+{
+    initProjectiles(b, n, ax, ay);
+    for (int i=0; i<n; i++)
+        launchProjectile(b, i, CANNON_MIN + (CANNON_MAX-CANNON_MIN)*(i%121)/120, 0.1 + 2.9*(i%97)/96, 2);
+}
+
+static double timeKernel (ProjectileBatch& b, void (*step)(ProjectileBatch&, float), int steps, float dt)
+{
+    auto start = chrono::steady_clock::now();
+    for (int s=0; s<steps; s++)
+        step(b, dt);
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void usage (const char* prog)
+{
+    printf("Usage: %s [--count N] [--steps N] [--dt SECONDS]\n", prog);
+}
+
+int main (int argc, char** argv)
+{
+    int count = 4096, steps = 2400;
+    float dt = 1.0f/240;
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--count") && i+1<argc)
+            count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--steps") && i+1<argc)
+            steps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--dt") && i+1<argc)
+            dt = atof(argv[++i]);
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (count < 1 || steps < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    float ax = airPreset(1), ay = gravityPreset(1);
+    ProjectileBatch scalar, simd;
+    launchAll(scalar, count, ax, ay);
+    launchAll(simd, count, ax, ay);
+
+    double ts = timeKernel(scalar, stepProjectilesScalar, steps, dt);
+    double tv = timeKernel(simd, stepProjectiles, steps, dt);
+
+    float maxdiff = 0;
+    int settled = 0;
+    for (int i=0; i<count; i++) {
+        maxdiff = fmax(maxdiff, fabs(scalar.sx[i]-simd.sx[i]));
+        maxdiff = fmax(maxdiff, fabs(scalar.sy[i]-simd.sy[i]));
+        settled += (simd.rest[i] != 0);
+    }
+
+    double work = (double)count*steps;
+    printf("projectiles: %d\n", count);
+    printf("steps: %d\n", steps);
+    printf("settled: %d\n", settled);
+    printf("scalar: %.1f Mprojectile-steps/s\n", work/ts/1e6);
+    printf("%s x%d: %.1f Mprojectile-steps/s\n", projectileKernelName(), projectileKernelWidth(), work/tv/1e6);
+    printf("speedup: %.2fx\n", ts/tv);
+    printf("max |scalar-simd| position: %g\n", maxdiff);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,214 @@
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "world.h"
+#include "projectiles.h"
+
+using namespace std;
+
+void initProjectiles (ProjectileBatch& b, int n, float ax, float ay)
+{
+    // Pad to a whole number of the widest vector so kernels never need a tail
+    int padded = (n+15) & ~15;
+    b.sx.assign(padded, CANNON_X + CANNON_LENGTH);
+    b.sy.assign(padded, CANNON_Y);
+    b.vx.assign(padded, 0);
+    b.vy.assign(padded, 0);
+    b.rest.assign(padded, 1);
+    b.count = n;
+    b.ax = ax;
+    b.ay = ay;
+}
+
+void launchProjectile (ProjectileBatch& b, int i, float angle, double charge_seconds, float powerfac)
+{
+    float th = angle*M_PI/180.0f;
+    float speed = charge_seconds*powerfac*LAUNCH_GAIN;
+    b.sx[i] = CANNON_X + CANNON_LENGTH*cos(th);
+    b.sy[i] = CANNON_Y + CANNON_LENGTH*sin(th);
+    b.vx[i] = speed*cos(th);
+    b.vy[i] = speed*sin(th);
+    b.rest[i] = 0;
+}
+
+/* Same motion as integrate() and checkcollisionground() in world.cpp */
+static inline void stepOne (float& sx, float& sy, float& vx, float& vy, float& rest, float ax, float ay, float dt)
+{
+    bool resting = rest != 0;
+    float brake = resting ? ROLL_FRICTION : (vx > AIR_MIN_SPEED) ? -ax : 0;
+    float drag = (vx > 0) ? -brake : brake;
+    float tx = dt;
+    if (brake > 0 && abs(vx) < brake*dt)
+        tx = abs(vx)/brake;
+    sx += vx*tx + 0.5f*drag*tx*tx;
+    vx = (tx < dt) ? 0 : vx + drag*dt;
+
+    if (resting)
+        return;
+    sy += vy*dt + 0.5f*ay*dt*dt;
+    vy += ay*dt;
+    if (sy <= GROUND_Y) {
+        sy = GROUND_Y;
+        vy = -vy/4;
+        vx = vx*3/5;
+        if (vy < REST_SPEED) {
+            vy = 0;
+            rest = 1;
+        }
+    }
+}
+
+void stepProjectilesScalar (ProjectileBatch& b, float dt)
+{
+    for (int i=0; i<b.count; i++)
+        stepOne(b.sx[i], b.sy[i], b.vx[i], b.vy[i], b.rest[i], b.ax, b.ay, dt);
+}
+
+/* Thin wrappers so one kernel body serves every instruction set. Masks are
+ * whatever the ISA compares produce; sel(m, a, b) picks a where m is set. */
+#if defined(__AVX512F__)
+struct Lanes {
+    typedef __m512 V;
+    typedef __mmask16 M;
+    enum { width = 16 };
+    static V load (const float* p) { return _mm512_loadu_ps(p); }
+    static void store (float* p, V v) { _mm512_storeu_ps(p, v); }
+    static V set (float f) { return _mm512_set1_ps(f); }
+    static V add (V a, V b) { return _mm512_add_ps(a, b); }
+    static V sub (V a, V b) { return _mm512_sub_ps(a, b); }
+    static V mul (V a, V b) { return _mm512_mul_ps(a, b); }
+    static V div (V a, V b) { return _mm512_div_ps(a, b); }
+    static V abs (V a) { return _mm512_abs_ps(a); }
+    static M gt (V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static M lt (V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static M le (V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+    static M and_ (M a, M b) { return a & b; }
+    static M andnot (M a, M b) { return ~a & b; }
+    static V sel (M m, V a, V b) { return _mm512_mask_blend_ps(m, b, a); }
+};
+static const char kernel_name[] = "avx512";
+#elif defined(__AVX__)
+struct Lanes {
+    typedef __m256 V;
+    typedef __m256 M;
+    enum { width = 8 };
+    static V load (const float* p) { return _mm256_loadu_ps(p); }
+    static void store (float* p, V v) { _mm256_storeu_ps(p, v); }
+    static V set (float f) { return _mm256_set1_ps(f); }
+    static V add (V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub (V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul (V a, V b) { return _mm256_mul_ps(a, b); }
+    static V div (V a, V b) { return _mm256_div_ps(a, b); }
+    static V abs (V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static M gt (V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M lt (V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M le (V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static M and_ (M a, M b) { return _mm256_and_ps(a, b); }
+    static M andnot (M a, M b) { return _mm256_andnot_ps(a, b); }
+    static V sel (M m, V a, V b) { return _mm256_blendv_ps(b, a, m); }
+};
+static const char kernel_name[] = "avx";
+#elif defined(__SSE2__)
+struct Lanes {
+    typedef __m128 V;
+    typedef __m128 M;
+    enum { width = 4 };
+    static V load (const float* p) { return _mm_loadu_ps(p); }
+    static void store (float* p, V v) { _mm_storeu_ps(p, v); }
+    static V set (float f) { return _mm_set1_ps(f); }
+    static V add (V a, V b) { return _mm_add_ps(a, b); }
+    static V sub (V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul (V a, V b) { return _mm_mul_ps(a, b); }
+    static V div (V a, V b) { return _mm_div_ps(a, b); }
+    static V abs (V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static M gt (V a, V b) { return _mm_cmpgt_ps(a, b); }
+    static M lt (V a, V b) { return _mm_cmplt_ps(a, b); }
+    static M le (V a, V b) { return _mm_cmple_ps(a, b); }
+    static M and_ (M a, M b) { return _mm_and_ps(a, b); }
+    static M andnot (M a, M b) { return _mm_andnot_ps(a, b); }
+    static V sel (M m, V a, V b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+};
+static const char kernel_name[] = "sse2";
+#endif
+
+#ifdef __SSE2__
+/* Branch-free version of stepOne(), one vector of balls per iteration */
+template <class L>
+static void stepLanes (ProjectileBatch& b, float dt)
+{
+    typedef typename L::V V;
+    typedef typename L::M M;
+    const V zero = L::set(0), one = L::set(1), half = L::set(0.5f);
+    const V vdt = L::set(dt), airbrake = L::set(-b.ax);
+    const V roll = L::set(ROLL_FRICTION), airmin = L::set(AIR_MIN_SPEED);
+    const V ground = L::set(GROUND_Y), restspeed = L::set(REST_SPEED);
+    const V quarter = L::set(-0.25f), three = L::set(3), five = L::set(5);
+    const V fall = L::set(b.ay*dt), fallpos = L::set(0.5f*b.ay*dt*dt);
+
+    for (int i=0; i<b.count; i+=L::width) {
+        V sx = L::load(&b.sx[i]), sy = L::load(&b.sy[i]);
+        V vx = L::load(&b.vx[i]), vy = L::load(&b.vy[i]);
+        M resting = L::gt(L::load(&b.rest[i]), zero);
+
+        // Horizontal: air brake in flight, rolling friction on the ground,
+        // cut short at the moment the ball would stop
+        V brake = L::sel(resting, roll, L::sel(L::gt(vx, airmin), airbrake, zero));
+        V drag = L::sel(L::gt(vx, zero), L::sub(zero, brake), brake);
+        V speed = L::abs(vx);
+        M stops = L::and_(L::gt(brake, zero), L::lt(speed, L::mul(brake, vdt)));
+        V tx = L::sel(stops, L::div(speed, L::sel(stops, brake, one)), vdt);
+        sx = L::add(sx, L::add(L::mul(vx, tx), L::mul(L::mul(L::mul(half, drag), tx), tx)));
+        vx = L::sel(stops, zero, L::add(vx, L::mul(drag, vdt)));
+
+        // Vertical: only while airborne
+        V nsy = L::add(sy, L::add(L::mul(vy, vdt), fallpos));
+        V nvy = L::add(vy, fall);
+        sy = L::sel(resting, sy, nsy);
+        vy = L::sel(resting, vy, nvy);
+
+        // Ground bounce
+        M hit = L::andnot(resting, L::le(sy, ground));
+        V bvy = L::mul(vy, quarter);
+        M settle = L::and_(hit, L::lt(bvy, restspeed));
+        sy = L::sel(hit, ground, sy);
+        vx = L::sel(hit, L::div(L::mul(vx, three), five), vx);
+        vy = L::sel(settle, zero, L::sel(hit, bvy, vy));
+
+        L::store(&b.sx[i], sx);
+        L::store(&b.sy[i], sy);
+        L::store(&b.vx[i], vx);
+        L::store(&b.vy[i], vy);
+        L::store(&b.rest[i], L::sel(settle, one, L::load(&b.rest[i])));
+    }
+}
+#endif
+
+void stepProjectiles (ProjectileBatch& b, float dt)
+{
+#ifdef __SSE2__
+    stepLanes<Lanes>(b, dt);
+#else
+    stepProjectilesScalar(b, dt);
+#endif
+}
+
+const char* projectileKernelName ()
+{
+#ifdef __SSE2__
+    return kernel_name;
+#else
+    return "scalar";
+#endif
+}
+
+int projectileKernelWidth ()
+{
+#ifdef __SSE2__
+    return Lanes::width;
+#else
+    return 1;
+#endif
+}
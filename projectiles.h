@@ -0,0 +1,35 @@
+#ifndef PROJECTILES_H
+#define PROJECTILES_H
+
+#include <vector>
+
+/* Structure-of-arrays store for many cannonballs in flight at once, for the
+ * sweep, AI and multi-ball modes. All balls in a batch share gravity and air
+ * resistance. Only free flight and the ground bounce are integrated here;
+ * targets and barriers still go through World. */
+struct ProjectileBatch {
+    std::vector<float> sx, sy;  // position
+    std::vector<float> vx, vy;  // velocity
+    std::vector<float> rest;    // 1 once the ball has settled on the ground, else 0
+    int count;
+    float ax, ay;               // air resistance, gravity
+};
+
+/* Size for n balls, all at the cannon mouth and at rest */
+void initProjectiles (ProjectileBatch& b, int n, float ax, float ay);
+
+/* Put ball i at the mouth of a cannon at angle degrees, fired with the
+ * given charge and power factor (same launch as fireCannon) */
+void launchProjectile (ProjectileBatch& b, int i, float angle, double charge_seconds, float powerfac);
+
+/* Advance every ball by dt with the widest SIMD kernel this build supports */
+void stepProjectiles (ProjectileBatch& b, float dt);
+
+/* Reference one-ball-at-a-time kernel */
+void stepProjectilesScalar (ProjectileBatch& b, float dt);
+
+/* "avx512", "avx", "sse2" or "scalar", and its lane count */
+const char* projectileKernelName ();
+int projectileKernelWidth ();
+
+#endif
@@ -0,0 +1,53 @@
+#include <cstring>
+
+#include "renderqueue.h"
+
+using namespace std;
+
+void mergeCommands (const CommandBuffer* buffers, int n, vector<RenderCommand>& out)
+{
+    size_t total = 0;
+    for (int i=0; i<n; i++)
+        total += buffers[i].commands.size();
+    out.resize(total);
+
+    size_t k = 0;
+    for (int i=0; i<n; i++) {
+        const vector<RenderCommand>& c = buffers[i].commands;
+        for (size_t j=0; j<c.size(); j++, k++) {
+            out[k] = c[j];
+            out[k].key = (c[j].key & ~KEY_SEQUENCE_MASK) | k;
+        }
+    }
+}
+
+void sortCommands (vector<RenderCommand>& commands, vector<RenderCommand>& scratch)
+{
+    size_t n = commands.size();
+    if (n < 2)
+        return;
+    scratch.resize(n);
+    RenderCommand* from = commands.data();
+    RenderCommand* to = scratch.data();
+
+    size_t count[256];
+    for (int shift=0; shift<64; shift+=8) {
+        memset(count, 0, sizeof(count));
+        for (size_t i=0; i<n; i++)
+            count[(from[i].key >> shift) & 0xff]++;
+        if (count[(from[0].key >> shift) & 0xff] == n)
+            continue;                   // every key has this digit
+
+        size_t sum = 0;
+        for (int d=0; d<256; d++) {
+            size_t c = count[d];
+            count[d] = sum;
+            sum += c;
+        }
+        for (size_t i=0; i<n; i++)
+            to[count[(from[i].key >> shift) & 0xff]++] = from[i];
+        swap(from, to);
+    }
+    if (from != commands.data())
+        commands.swap(scratch);
+}
@@ -0,0 +1,59 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+struct VAO;
+
+/* Render command queue.
+ * draw() records what to draw as commands into command buffers (one per
+ * recording thread), merges them, sorts them by key and submits them in
+ * one loop. The key orders by layer first, so nothing moves from one
+ * layer to another, then by what state the draw needs: program, fill mode
+ * and mesh, so draws that share them end up next to each other. The low
+ * bits are the command's place in the merged recording order, which keeps
+ * the sort total and tells the submitter how far forward to put each draw
+ * so that overlaps come out as they were recorded. Nothing here touches GL. */
+
+#define KEY_LAYER_SHIFT     60      // 4 bits
+#define KEY_PROGRAM_SHIFT   56      // 4 bits
+#define KEY_MODE_SHIFT      52      // 4 bits
+#define KEY_MESH_SHIFT      32      // 20 bits
+#define KEY_SEQUENCE_MASK   0xffffffffull
+
+/* Layers, back to front */
+enum RenderLayer { LAYER_BACK, LAYER_CANNON, LAYER_LEVEL, LAYER_BALL, LAYER_FRONT };
+
+/* What to draw, placed at x, y, z and turned by angle (radians) */
+struct RenderCommand {
+    uint64_t key;
+    VAO* mesh;
+    float x, y, z, angle;
+};
+
+struct CommandBuffer {
+    std::vector<RenderCommand> commands;
+};
+
+inline uint64_t renderKey (int layer, int program, int mode, unsigned mesh)
+{
+    return (uint64_t)layer << KEY_LAYER_SHIFT | (uint64_t)program << KEY_PROGRAM_SHIFT
+         | (uint64_t)mode << KEY_MODE_SHIFT | (uint64_t)(mesh & 0xfffff) << KEY_MESH_SHIFT;
+}
+
+inline void recordCommand (CommandBuffer& b, uint64_t key, VAO* mesh, float x, float y, float z, float angle)
+{
+    RenderCommand c = { key, mesh, x, y, z, angle };
+    b.commands.push_back(c);
+}
+
+/* Concatenate buffers 0..n-1 into out and number the commands in that
+ * order */
+void mergeCommands (const CommandBuffer* buffers, int n, std::vector<RenderCommand>& out);
+
+/* Sort by key: LSD radix sort, 8 bits a pass, skipping passes where every
+ * key has the same digit. scratch is working space. */
+void sortCommands (std::vector<RenderCommand>& commands, std::vector<RenderCommand>& scratch);
+
+#endif
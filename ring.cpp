@@ -0,0 +1,113 @@
+#include <cstdio>
+
+#include "glstate.h"
+#include "ring.h"
+
+// Mapping and allocation go through GL_COPY_WRITE_BUFFER, which nothing
+// draws from, so they leave the array and uniform bindings alone
+#define RING_TARGET GL_COPY_WRITE_BUFFER
+
+// Offsets handed out are multiples of this, and so are sections
+#define RING_ALIGN 256
+
+static size_t roundUp (size_t n, size_t align)
+{
+    return (n + align-1)/align*align;
+}
+
+static void allocateRing (StreamRing& r, size_t section)
+{
+    r.section = roundUp(section, RING_ALIGN);
+    glGenBuffers(1, &r.buffer);
+    setBuffer(RING_TARGET, r.buffer);
+    if (r.persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(RING_TARGET, RING_FRAMES*r.section, NULL, flags);
+        r.mapped = (char*)glMapBufferRange(RING_TARGET, 0, RING_FRAMES*r.section, flags);
+    }
+    else {
+        glBufferData(RING_TARGET, RING_FRAMES*r.section, NULL, GL_STREAM_DRAW);
+        r.mapped = NULL;
+    }
+    for (int i=0; i<RING_FRAMES; i++)
+        r.fence[i] = 0;
+}
+
+void createRing (StreamRing& r, size_t section)
+{
+    r.persistent = GLAD_GL_ARB_buffer_storage;
+    r.frame = RING_FRAMES-1;
+    r.reserved = r.used = 0;
+    r.waits = 0;
+    allocateRing(r, section);
+    printf("stream ring: %d x %zu bytes, %s\n", RING_FRAMES, r.section,
+            r.persistent ? "persistent mapped" : "unsynchronized glMapBufferRange");
+}
+
+void beginRingFrame (StreamRing& r, size_t bytes)
+{
+    if (bytes > r.section) {
+        // Frames still in flight keep the old buffer alive until they finish
+        if (r.persistent) {
+            setBuffer(RING_TARGET, r.buffer);
+            glUnmapBuffer(RING_TARGET);
+        }
+        glDeleteBuffers(1, &r.buffer);
+        forgetBuffer(r.buffer);
+        for (int i=0; i<RING_FRAMES; i++)
+            if (r.fence[i])
+                glDeleteSync(r.fence[i]);
+        allocateRing(r, bytes > 2*r.section ? bytes : 2*r.section);
+    }
+
+    r.frame = (r.frame+1) % RING_FRAMES;
+    GLsync& fence = r.fence[r.frame];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            r.waits++;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+                ;
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    r.reserved = bytes;
+    r.used = 0;
+    if (!r.persistent && bytes > 0) {
+        setBuffer(RING_TARGET, r.buffer);
+        r.mapped = (char*)glMapBufferRange(RING_TARGET, r.frame*r.section, bytes,
+                GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    }
+}
+
+void* ringAlloc (StreamRing& r, size_t bytes, size_t align, GLintptr& offset)
+{
+    if (!r.mapped && bytes > 0) {
+        fprintf(stderr, "stream ring: section not mapped\n");
+        return NULL;
+    }
+    size_t start = roundUp(r.used, align);
+    if (start + bytes > r.reserved) {
+        fprintf(stderr, "stream ring: %zu bytes over this frame's %zu\n", start + bytes - r.reserved, r.reserved);
+        return NULL;
+    }
+    r.used = start + bytes;
+    offset = r.frame*r.section + start;
+    return r.persistent ? r.mapped + offset : r.mapped + start;
+}
+
+void endRingWrites (StreamRing& r)
+{
+    if (!r.persistent && r.reserved > 0) {
+        setBuffer(RING_TARGET, r.buffer);
+        glUnmapBuffer(RING_TARGET);
+        r.mapped = NULL;
+    }
+}
+
+void endRingFrame (StreamRing& r)
+{
+    r.fence[r.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
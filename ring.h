@@ -0,0 +1,47 @@
+#ifndef RING_H
+#define RING_H
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+/* Ring allocator for data written once a frame and drawn from that frame.
+ * One buffer is split into RING_FRAMES sections used in turn; a frame
+ * writes only its own section, and a fence after its draws says when the
+ * GPU is done with it, so the CPU only ever waits if it gets RING_FRAMES
+ * frames ahead. With ARB_buffer_storage the buffer is mapped once,
+ * persistent and coherent; without it (plain GL 3.3) each frame maps its
+ * section with GL_MAP_UNSYNCHRONIZED_BIT, relying on the same fences. */
+#define RING_FRAMES 3
+
+struct StreamRing {
+    GLuint buffer;
+    bool persistent;
+    char* mapped;               // whole buffer if persistent, else this frame's section while writing
+    size_t section;             // bytes per frame
+    size_t reserved;            // bytes this frame asked for
+    size_t used;
+    int frame;                  // section being written
+    GLsync fence[RING_FRAMES];
+    long waits;                 // frames that had to wait for their section
+};
+
+/* A ring of RING_FRAMES sections of at least section bytes */
+void createRing (StreamRing& r, size_t section);
+
+/* Start the next section, with room for bytes (growing the ring if they
+ * don't fit), waiting only if the GPU still reads it */
+void beginRingFrame (StreamRing& r, size_t bytes);
+
+/* bytes of this frame's section at a multiple of align. Returns where to
+ * write them, or NULL with a message if they don't fit or the section is
+ * not mapped; offset is where they are in the buffer. */
+void* ringAlloc (StreamRing& r, size_t bytes, size_t align, GLintptr& offset);
+
+/* Done writing: call before drawing from the ring */
+void endRingWrites (StreamRing& r);
+
+/* After the frame's draws: fence the section */
+void endRingFrame (StreamRing& r);
+
+#endif
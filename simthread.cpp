@@ -0,0 +1,203 @@
+#include <chrono>
+
+#include "simthread.h"
+#include "profile.h"
+
+using namespace std;
+
+static double steadySeconds ()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double clockSeconds (const SimThread& s)
+{
+    return s.time_source ? s.time_source() : steadySeconds();
+}
+
+static void applyInput (SimThread& s, const SimInput& in)
+{
+    World& w = *s.world;
+    switch (in.kind) {
+        case INPUT_TURN:
+            if (in.turn == 0 || !w.in_flight)
+                w.cannonrotflag = in.turn;
+            break;
+        case INPUT_CHARGE:
+            if (!w.in_flight)
+                s.charge_start = in.time;
+            break;
+        case INPUT_FIRE:
+            if (s.charge_start >= 0)
+                fireCannon(w, in.time - s.charge_start);
+            s.charge_start = -1;
+            break;
+        case INPUT_RELOAD:
+            reloadCannon(w);
+            break;
+    }
+}
+
+/* Apply the queued events that happened by time */
+static void applyInputs (SimThread& s, double time)
+{
+    InputQueue& q = s.input;
+    unsigned head = q.head.load(memory_order_relaxed);
+    unsigned tail = q.tail.load(memory_order_acquire);
+    for (; head != tail; head++) {
+        const SimInput& in = q.events[head % INPUT_QUEUE_SIZE];
+        if (in.time > time)
+            break;
+        applyInput(s, in);
+    }
+    q.head.store(head, memory_order_release);
+}
+
+/* Fill the back slot from the world and swap it into the middle */
+static void publish (SimThread& s, double time)
+{
+    const World& w = *s.world;
+    Snapshot& snap = s.slots[s.back];
+    snap.time = time;
+    snap.prev_sx = w.prev_sx; snap.prev_sy = w.prev_sy;
+    snap.sx = w.sx; snap.sy = w.sy;
+    snap.prev_cannon_rotation = w.prev_cannon_rotation;
+    snap.cannon_rotation = w.cannon_rotation;
+    snap.prev_bullet_rotation = w.prev_bullet_rotation;
+    snap.bullet_rotation = w.bullet_rotation;
+    snap.in_flight = w.in_flight;
+    snap.flagscore = w.flagscore;
+    snap.knocked = w.knocked.size();
+
+    size_t k = 0;
+    for (size_t i=0; i<s.spinners.size(); i++, k++) {
+        const Target& t = w.targets[s.spinners[i]];
+        snap.prev_spin[k] = t.prev_rotation;
+        snap.spin[k] = t.rotation;
+    }
+    for (size_t i=0; i<w.barriers.size(); i++, k++) {
+        snap.prev_spin[k] = w.barriers[i].prev_rotation;
+        snap.spin[k] = w.barriers[i].rotation;
+    }
+
+    s.back = s.middle.exchange(s.back | SNAPSHOT_FRESH, memory_order_acq_rel) & 3;
+    s.published++;
+}
+
+void initSim (SimThread& s, World& w, double hz)
+{
+    s.world = &w;
+    initClock(s.clock, hz);
+    s.spinners = w.spinning;
+    s.mover.assign(w.targets.size(), -1);
+    for (size_t k=0; k<s.spinners.size(); k++)
+        s.mover[s.spinners[k]] = k;
+    size_t movers = s.spinners.size() + w.barriers.size();
+    for (int i=0; i<3; i++) {
+        s.slots[i].prev_spin.assign(movers, 0);
+        s.slots[i].spin.assign(movers, 0);
+    }
+    s.back = 0;
+    s.middle.store(1);
+    s.front = 2;
+    s.input.head = s.input.tail = 0;
+    s.input.dropped = 0;
+    s.charge_start = -1;
+    s.running = false;
+    s.start = clockSeconds(s);
+    s.published = 0;
+    publish(s, 0);
+}
+
+double simNow (const SimThread& s)
+{
+    return clockSeconds(s) - s.start;
+}
+
+/* The thread: tick whenever a tick is due, publish, sleep until the next */
+static void simLoop (SimThread* sp)
+{
+    SimThread& s = *sp;
+    traceThreadName("simulation");
+    double step = s.clock.step;
+    double due = simNow(s) + step;
+    while (s.running.load(memory_order_relaxed)) {
+        double now = simNow(s);
+        int n = 0;
+        while (due <= now && n < s.clock.max_ticks) {
+            applyInputs(s, due);
+            updateWorld(*s.world, step);
+            due += step;
+            n++;
+        }
+        // Too far behind to catch up: drop the backlog, as advanceClock does
+        if (due <= now) {
+            applyInputs(s, now);
+            due = now + step;
+        }
+        if (n > 0)
+            publish(s, due - step);
+        this_thread::sleep_for(chrono::duration<double>(due - simNow(s)));
+    }
+}
+
+void startSim (SimThread& s)
+{
+    s.start = clockSeconds(s);
+    s.running = true;
+    s.thread = thread(simLoop, &s);
+}
+
+void stopSim (SimThread& s)
+{
+    if (!s.running)
+        return;
+    s.running = false;
+    s.thread.join();
+}
+
+struct InlineTick {
+    SimThread* s;
+    double now;
+};
+
+/* Inputs up to the end of the tick about to run, as simLoop() applies them */
+static void inlineTick (void* arg, double lag)
+{
+    InlineTick& t = *(InlineTick*)arg;
+    applyInputs(*t.s, t.now - lag);
+}
+
+float advanceSim (SimThread& s, double elapsed)
+{
+    InlineTick t = { &s, simNow(s) };
+    float alpha = advanceClock(s.clock, *s.world, elapsed, inlineTick, &t);
+    publish(s, t.now - alpha*s.clock.step);
+    return alpha;
+}
+
+void sendInput (SimThread& s, int kind, int turn)
+{
+    InputQueue& q = s.input;
+    unsigned tail = q.tail.load(memory_order_relaxed);
+    if (tail - q.head.load(memory_order_acquire) == INPUT_QUEUE_SIZE) {
+        q.dropped++;
+        return;
+    }
+    SimInput in = { simNow(s), kind, turn };
+    q.events[tail % INPUT_QUEUE_SIZE] = in;
+    q.tail.store(tail + 1, memory_order_release);
+}
+
+const Snapshot& latestSnapshot (SimThread& s)
+{
+    if (s.middle.load(memory_order_relaxed) & SNAPSHOT_FRESH)
+        s.front = s.middle.exchange(s.front, memory_order_acq_rel) & 3;
+    return s.slots[s.front];
+}
+
+float snapshotAlpha (const SimThread& s, const Snapshot& snap, double now)
+{
+    float alpha = (now - snap.time)/s.clock.step;
+    return alpha < 0 ? 0 : alpha > 1 ? 1 : alpha;
+}
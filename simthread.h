@@ -0,0 +1,113 @@
+#ifndef SIMTHREAD_H
+#define SIMTHREAD_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "world.h"
+
+/* Simulation thread.
+ * The world ticks on its own thread at the clock's fixed rate, and after
+ * each batch of ticks publishes a snapshot of what drawing needs through a
+ * lock-free triple buffer: the thread writes one slot while the renderer
+ * reads another, and the third holds the newest finished one, swapped in
+ * with one atomic exchange on either side. Neither side ever waits for the
+ * other, and the renderer always gets the newest snapshot. Input goes the
+ * other way as timestamped events through a single-producer single-consumer
+ * ring, drained at tick boundaries.
+ *
+ * Only what changes is copied: targets and fans stay where they are, so a
+ * snapshot holds the ball, the cannon and the angles of what spins. A
+ * knocked-down target is told by the snapshot's count of world.knocked
+ * entries, which never move once written. Without startSim() the same
+ * snapshots are made by advanceSim() on the caller's thread. */
+
+/* Set slot index in SimThread::middle when it holds a snapshot the
+ * renderer hasn't taken */
+#define SNAPSHOT_FRESH 4
+
+struct Snapshot {
+    double time;                    // simNow() when its last tick was due
+    float prev_sx, prev_sy, sx, sy;
+    float prev_cannon_rotation, cannon_rotation;
+    float prev_bullet_rotation, bullet_rotation;
+    bool in_flight;
+    int flagscore;
+    int knocked;                    // world.knocked entries it covers
+    std::vector<float> prev_spin, spin;     // per mover: spinning targets, then fans
+};
+
+enum SimInputKind { INPUT_TURN, INPUT_CHARGE, INPUT_FIRE, INPUT_RELOAD };
+
+/* One input event, stamped on simNow()'s clock when it happened. A shot's
+ * power is the time between its INPUT_CHARGE and INPUT_FIRE, so it doesn't
+ * depend on when in the frame events were polled. */
+struct SimInput {
+    double time;
+    int kind;
+    int turn;                       // INPUT_TURN: -1, 0, 1 as for cannonrotflag
+};
+
+#define INPUT_QUEUE_SIZE 256        // power of two
+
+/* Lock-free ring from the thread running the callbacks to the simulation */
+struct InputQueue {
+    SimInput events[INPUT_QUEUE_SIZE];
+    std::atomic<unsigned> head;     // next to read; written by the consumer
+    std::atomic<unsigned> tail;     // next to write; written by the producer
+    long dropped;                   // events lost to a full queue
+};
+
+struct SimThread {
+    World* world;
+    SimClock clock;
+    std::vector<int> spinners;      // targets that spin, in order
+    std::vector<int> mover;         // per target, its place in the movers or -1
+
+    Snapshot slots[3];
+    std::atomic<int> middle;        // slot between the two sides | SNAPSHOT_FRESH
+    int back;                       // slot the simulation writes
+    int front;                      // slot the renderer reads
+
+    InputQueue input;
+    double charge_start;            // time of the pending INPUT_CHARGE, or < 0
+
+    std::thread thread;
+    std::atomic<bool> running;
+    double start;                   // clock seconds at startSim()
+    double (*time_source)();        // the clock, if not the steady clock;
+                                    // set before initSim()
+    long published;                 // snapshots made
+};
+
+/* Take over w, ticking at hz, with a first snapshot ready to read */
+void initSim (SimThread& s, World& w, double hz);
+
+/* Tick on a thread of its own from now on */
+void startSim (SimThread& s);
+
+/* Stop and join the thread, if it runs */
+void stopSim (SimThread& s);
+
+/* Without the thread: run the ticks elapsed real seconds cover, each after
+ * the inputs stamped up to its end as on the thread, and publish the
+ * result. Returns advanceClock()'s alpha. */
+float advanceSim (SimThread& s, double elapsed);
+
+/* Seconds since startSim(), on the thread's clock: the steady clock, or
+ * time_source, e.g. a fixed frame clock that replays the same way at any
+ * frame rate */
+double simNow (const SimThread& s);
+
+/* Queue an event stamped now; it is applied before the first tick due
+ * after it. Only ever called from one thread. */
+void sendInput (SimThread& s, int kind, int turn);
+
+/* The newest snapshot; stays valid until the next call */
+const Snapshot& latestSnapshot (SimThread& s);
+
+/* How far now is past the snapshot's last tick, 0..1, for interpolation */
+float snapshotAlpha (const SimThread& s, const Snapshot& snap, double now);
+
+#endif
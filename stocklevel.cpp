@@ -0,0 +1,13 @@
+#include "level.h"
+
+/* Level 1, compiled in so the game runs without any level files. The
+ * records are generated from levels/level1.txt by levelc --cpp. */
+static const LevelObject stock_objects[] = {
+#include "levels/level1.inc"
+};
+
+const Level& stockLevel ()
+{
+    static const Level level = { stock_objects, (int)(sizeof(stock_objects)/sizeof(stock_objects[0])), NULL, 0 };
+    return level;
+}
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "world.h"
+#include "level.h"
+
+using namespace std;
+
+/* Parameter sweep over the cannon.
+ * Fires one shot into a fresh copy of the level (stock, or --level) for
+ * every combination of cannon angle and charge time, under every
+ * gravity/air preset main() offers, spread over a pool of worker threads.
+ * For each preset it writes a score heatmap and a hit-set heatmap as CSV
+ * grids with one row per angle and one column per charge. A hit-set cell
+ * lists every target the shot destroyed, by index, separated by ';', so
+ * levels of any size come out whole. With --events each shot jumps from
+ * contact to contact instead of ticking at --dt, which then only sets the
+ * tick length used near the fans. */
+
+struct Shot {
+    int score;
+    vector<int> hits;           // destroyed targets, ascending
+};
+
+struct Preset {
+    const char* name;
+    int gravity, air;
+};
+
+static const Preset presets[] = {
+    { "earth_low",    1, 1 },
+    { "earth_medium", 1, 2 },
+    { "earth_high",   1, 3 },
+    { "moon_low",     2, 1 },
+    { "moon_medium",  2, 2 },
+    { "moon_high",    2, 3 },
+};
+#define NUM_PRESETS (int)(sizeof(presets)/sizeof(presets[0]))
+
+/* Shots handed to a worker at a time */
+#define SWEEP_CHUNK 64
+
+struct Sweep {
+    int angles, charges;
+    double max_charge;
+    float dt;
+    double max_time;
+    bool events;                // event-driven stepping instead of fixed ticks
+    vector<World> levels;       // one untouched level per preset
+    vector<Shot> results;       // preset-major, then angle, then charge
+    atomic<long> next;
+    atomic<long> ticks;
+};
+
+static float sweepAngle (const Sweep& s, int i)
+{
+    if (s.angles == 1)
+        return CANNON_MIN;
+    return CANNON_MIN + (CANNON_MAX-CANNON_MIN)*i/(s.angles-1);
+}
+
+static double sweepCharge (const Sweep& s, int j)
+{
+    return s.max_charge*(j+1)/s.charges;
+}
+
+static void worker (Sweep* s)
+{
+    long per_preset = (long)s->angles*s->charges;
+    long total = per_preset*NUM_PRESETS;
+    World w;
+    long ticks = 0;
+    for (;;) {
+        long begin = s->next.fetch_add(SWEEP_CHUNK);
+        if (begin >= total)
+            break;
+        long end = (begin+SWEEP_CHUNK < total) ? begin+SWEEP_CHUNK : total;
+        for (long k=begin; k<end; k++) {
+            int p = k/per_preset;
+            int i = (k%per_preset)/s->charges;
+            int j = k%s->charges;
+
+            // Assigning over the same World reuses its vectors' storage
+            w = s->levels[p];
+            if (s->events)
+                ticks += simulateShotEvents(w, sweepAngle(*s, i), sweepCharge(*s, j), s->dt, s->max_time);
+            else
+                ticks += simulateShot(w, sweepAngle(*s, i), sweepCharge(*s, j), s->dt, s->max_time);
+
+            Shot& r = s->results[k];
+            r.score = w.flagscore;
+            r.hits.assign(w.knocked.begin(), w.knocked.end());
+            sort(r.hits.begin(), r.hits.end());
+        }
+    }
+    s->ticks += ticks;
+}
+
+static bool writeHeatmap (const Sweep& s, int p, const string& dir, bool hits)
+{
+    string path = dir + "/" + presets[p].name + (hits ? "_hits.csv" : "_score.csv");
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        perror(path.c_str());
+        return false;
+    }
+    fprintf(f, "angle\\charge");
+    for (int j=0; j<s.charges; j++)
+        fprintf(f, ",%.4f", sweepCharge(s, j));
+    fprintf(f, "\n");
+    for (int i=0; i<s.angles; i++) {
+        fprintf(f, "%.3f", sweepAngle(s, i));
+        const Shot* row = &s.results[((long)p*s.angles + i)*s.charges];
+        for (int j=0; j<s.charges; j++) {
+            if (hits) {
+                fputc(',', f);
+                for (size_t t=0; t<row[j].hits.size(); t++)
+                    fprintf(f, t ? ";%d" : "%d", row[j].hits[t]);
+            }
+            else
+                fprintf(f, ",%d", row[j].score);
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return true;
+}
+
+static void usage (const char* prog)
+{
+    printf("Usage: %s [--angles N] [--charges N] [--max-charge SECONDS] [--dt SECONDS]\n"
+           "          [--max-time SECONDS] [--threads N] [--out DIR] [--events] [--level FILE.lvl]\n", prog);
+}
+
+int main (int argc, char** argv)
+{
+    Sweep s;
+    s.angles = 121;             // one per degree over CANNON_MIN..CANNON_MAX
+    s.charges = 1378;           // ~10^6 shots over the six presets
+    s.max_charge = 3;
+    s.dt = 1.0f/240;
+    s.max_time = 20;
+    s.events = false;
+    int threads = thread::hardware_concurrency();
+    string dir = ".";
+    const char* level_path = NULL;
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--angles") && i+1<argc)
+            s.angles = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--charges") && i+1<argc)
+            s.charges = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--max-charge") && i+1<argc)
+            s.max_charge = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--dt") && i+1<argc)
+            s.dt = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--max-time") && i+1<argc)
+            s.max_time = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i+1<argc)
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--out") && i+1<argc)
+            dir = argv[++i];
+        else if (!strcmp(argv[i], "--events"))
+            s.events = true;
+        else if (!strcmp(argv[i], "--level") && i+1<argc)
+            level_path = argv[++i];
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (s.angles < 1 || s.charges < 1 || s.dt <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (threads < 1)
+        threads = 1;
+
+    Level level = stockLevel();
+    if (level_path && !loadLevel(level_path, level))
+        return EXIT_FAILURE;
+    s.levels.resize(NUM_PRESETS);
+    for (int p=0; p<NUM_PRESETS; p++)
+        initWorld(s.levels[p], level, airPreset(presets[p].air), gravityPreset(presets[p].gravity));
+    unloadLevel(level);
+    long total = (long)s.angles*s.charges*NUM_PRESETS;
+    s.results.resize(total);
+    s.next = 0;
+    s.ticks = 0;
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> pool;
+    for (int i=0; i<threads; i++)
+        pool.push_back(thread(worker, &s));
+    for (size_t i=0; i<pool.size(); i++)
+        pool[i].join();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    for (int p=0; p<NUM_PRESETS; p++) {
+        if (!writeHeatmap(s, p, dir, false) || !writeHeatmap(s, p, dir, true))
+            return EXIT_FAILURE;
+
+        long best = (long)p*s.angles*s.charges;
+        for (long k=best; k<(long)(p+1)*s.angles*s.charges; k++)
+            if (s.results[k].score > s.results[best].score)
+                best = k;
+        long local = best - (long)p*s.angles*s.charges;
+        printf("%-13s best score %3d at angle %7.3f charge %.4f\n", presets[p].name, s.results[best].score,
+                sweepAngle(s, local/s.charges), sweepCharge(s, local%s.charges));
+    }
+
+    printf("shots: %ld\n", total);
+    printf("%s: %ld\n", s.events ? "steps" : "ticks", (long)s.ticks);
+    printf("threads: %d\n", threads);
+    printf("elapsed: %.3f ms\n", ms);
+    printf("shots/s: %.0f\n", total/(ms/1000));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,695 @@
+#include <cmath>
+#include <utility>
+
+#include "world.h"
+#include "level.h"
+#include "profile.h"
+
+using namespace std;
+
+/* Responses kept from the old draw(). A block hit set the velocity
+ * component it came in on to -v*(3/4), which is 0 in integer arithmetic:
+ * the ball stops dead against the face and drops. A fan hit reversed the
+ * velocity with no loss (ux=-vx), so the bounce off a blade keeps its
+ * energy too. */
+#define TARGET_RESTITUTION 0.0f
+#define TARGET_PUSHBACK    0.3f
+#define BARRIER_RESTITUTION 1.0f
+#define BARRIER_CLEARANCE   1e-3f  // gap left between ball and blade after a hit
+#define SWEEP_TOLERANCE     1e-4f  // distance at which the swept ball counts as touching
+#define SWEEP_MAX_ITERATIONS 64
+
+static Target makeTarget (const LevelObject& o, int object)
+{
+    Target t;
+    t.x = o.x; t.y = o.y;
+    t.hx = o.hx; t.hy = o.hy;
+    t.side_x = o.side_x; t.top_y = o.top_y;
+    t.rotation = t.prev_rotation = 0; t.spin = o.spin;
+    t.score = o.score;
+    t.bounce_both = (o.flags & LEVEL_BOUNCE_BOTH) != 0;
+    t.destroyed = false;
+    t.object = object;
+    return t;
+}
+
+static Barrier makeBarrier (const LevelObject& o, int object)
+{
+    Barrier b;
+    b.x = o.x; b.y = o.y;
+    b.hw = o.hx; b.hh = o.hy;
+    b.rotation = b.prev_rotation = 0; b.spin = o.spin;
+    b.cos_rot = b.prev_cos = 1;
+    b.sin_rot = b.prev_sin = 0;
+    b.object = object;
+    return b;
+}
+
+/* The square a fan's blade can sweep, as a box for the fan grid */
+static Target fanBox (const Barrier& b)
+{
+    Target t;
+    t.x = b.x; t.y = b.y;
+    t.hx = t.hy = barrierReach(b);
+    t.destroyed = false;
+    return t;
+}
+
+/* Sit the ball at the mouth of the cannon */
+static void placeBall (World& w)
+{
+    w.sx = CANNON_X + CANNON_LENGTH*cos(w.cannon_rotation*M_PI/180.0f);
+    w.sy = CANNON_Y + CANNON_LENGTH*sin(w.cannon_rotation*M_PI/180.0f);
+}
+
+float gravityPreset (int choice)
+{
+    return (choice==1) ? -15 : -5;
+}
+
+float airPreset (int choice)
+{
+    return (choice==1) ? -1 : (choice==2) ? -4 : -8;
+}
+
+/* Make the previous-tick transforms match the current ones, so a jump
+ * (reload, new shot, new level) is not smeared by interpolation */
+static void snapPrevious (World& w)
+{
+    w.prev_sx = w.sx;
+    w.prev_sy = w.sy;
+    w.prev_cannon_rotation = w.cannon_rotation;
+    w.prev_bullet_rotation = w.bullet_rotation;
+    for (size_t k=0; k<w.spinning.size(); k++) {
+        Target& t = w.targets[w.spinning[k]];
+        t.prev_rotation = t.rotation;
+    }
+    for (size_t i=0; i<w.barriers.size(); i++) {
+        Barrier& b = w.barriers[i];
+        b.prev_rotation = b.rotation;
+        b.prev_cos = b.cos_rot;
+        b.prev_sin = b.sin_rot;
+    }
+}
+
+void initWorld (World& w, const Level& level, float ax, float ay)
+{
+    w.vx = w.vy = 0;
+    w.ax = ax; w.ay = ay;
+    w.powerfac = 2;
+    w.in_flight = false;
+    w.resting = false;
+    w.cannon_rotation = 0;
+    w.cannonrotflag = 0;
+    w.bullet_rotation = 0;
+    placeBall(w);
+
+    // Walls are scenery; only targets and fans take part in the simulation
+    w.targets.clear();
+    w.spinning.clear();
+    w.knocked.clear();
+    w.barriers.clear();
+    w.fan_boxes.clear();
+    for (int i=0; i<level.count; i++) {
+        const LevelObject& o = level.objects[i];
+        if (o.kind == LEVEL_TARGET) {
+            if (o.spin != 0)
+                w.spinning.push_back(w.targets.size());
+            w.targets.push_back(makeTarget(o, i));
+        }
+        else if (o.kind == LEVEL_BARRIER) {
+            w.barriers.push_back(makeBarrier(o, i));
+            w.fan_boxes.push_back(fanBox(w.barriers.back()));
+        }
+    }
+    w.standing = w.targets.size();
+    buildGrid(w.grid, w.targets);
+    buildGrid(w.fan_grid, w.fan_boxes);
+    w.fans_near.clear();
+    // Never reallocated, so another thread can read entries already written
+    w.knocked.reserve(w.targets.size());
+
+    w.flagscore = 0;
+    w.time = 0;
+    w.ticks = 0;
+    snapPrevious(w);
+}
+
+void initWorld (World& w, float ax, float ay)
+{
+    initWorld(w, stockLevel(), ax, ay);
+}
+
+void fireCannon (World& w, double charge_seconds)
+{
+    if (w.in_flight)
+        return;
+    float speed = charge_seconds*w.powerfac*LAUNCH_GAIN;
+    placeBall(w);
+    w.vx = speed*cos(w.cannon_rotation*M_PI/180.0f);
+    w.vy = speed*sin(w.cannon_rotation*M_PI/180.0f);
+    w.in_flight = true;
+    w.resting = false;
+    snapPrevious(w);
+}
+
+void reloadCannon (World& w)
+{
+    w.in_flight = false;
+    w.resting = false;
+    w.vx = w.vy = 0;
+    placeBall(w);
+    snapPrevious(w);
+}
+
+bool shotFinished (const World& w)
+{
+    if (!w.in_flight)
+        return false;
+    if (w.sx <= -ARENA_HALF_WIDTH || w.sx >= ARENA_HALF_WIDTH)
+        return true;
+    return w.resting && w.vx == 0;
+}
+
+int targetsLeft (const World& w)
+{
+    return w.standing;
+}
+
+static void cannonanglecheck (World& w, float dt)
+{
+    if (w.cannonrotflag == 0)
+        return;
+    w.cannon_rotation += w.cannonrotflag*CANNON_TURN_RATE*dt;
+    if (w.cannon_rotation > CANNON_MAX)
+        w.cannon_rotation = CANNON_MAX;
+    if (w.cannon_rotation < CANNON_MIN)
+        w.cannon_rotation = CANNON_MIN;
+    placeBall(w);
+}
+
+/* Exact constant-acceleration step. Air resistance only brakes the ball
+ * while it is moving forward, rolling friction brakes it either way, and
+ * neither ever reverses it. */
+static void integrate (World& w, float dt)
+{
+    float brake = w.resting ? ROLL_FRICTION : (w.vx > AIR_MIN_SPEED) ? -w.ax : 0;
+    float drag = (w.vx > 0) ? -brake : brake;
+    float tx = dt;
+    if (brake > 0 && abs(w.vx) < brake*dt)
+        tx = abs(w.vx)/brake;
+    w.sx += w.vx*tx + 0.5f*drag*tx*tx;
+    w.vx = (tx < dt) ? 0 : w.vx + drag*dt;
+
+    if (!w.resting) {
+        w.sy += w.vy*dt + 0.5f*w.ay*dt*dt;
+        w.vy += w.ay*dt;
+    }
+}
+
+void knockDown (World& w, int i)
+{
+    Target& t = w.targets[i];
+    t.destroyed = true;
+    w.standing--;
+    w.knocked.push_back(i);
+    removeFromGrid(w.grid, w.targets, i);
+    w.flagscore += t.score;
+}
+
+/* Knock a block down and bounce the ball off the face it came through */
+static void hittarget (World& w, int i)
+{
+    Target& t = w.targets[i];
+    knockDown(w, i);
+    if (w.sx < t.side_x) {
+        w.vx = -w.vx*TARGET_RESTITUTION;
+        if (t.bounce_both)
+            w.vy = -w.vy*TARGET_RESTITUTION;
+        w.sx -= TARGET_PUSHBACK;
+    }
+    else if (w.sy > t.top_y) {
+        w.vy = -w.vy*TARGET_RESTITUTION;
+        if (t.bounce_both)
+            w.vx = -w.vx*TARGET_RESTITUTION;
+        w.sy += TARGET_PUSHBACK;
+    }
+}
+
+/* Swept test of this tick's path against the blocks, through the grid so
+ * only blocks near the path are looked at. The ball is backed up to where
+ * it entered the first block it crossed. */
+static void checkcollisiontargets (World& w)
+{
+    float u;
+    int i = gridFirstHit(w.grid, w.targets, w.prev_sx, w.prev_sy, w.sx, w.sy, u);
+    if (i < 0)
+        return;
+    w.sx = w.prev_sx + (w.sx-w.prev_sx)*u;
+    w.sy = w.prev_sy + (w.sy-w.prev_sy)*u;
+    hittarget(w, i);
+}
+
+float barrierReach (const Barrier& b)
+{
+    return sqrt(b.hw*b.hw + b.hh*b.hh) + BALL_RADIUS;
+}
+
+/* Signed distance from a ball centre at local (qx, qy) to the blade box,
+ * minus the ball radius, and the outward normal in the blade's frame */
+static float bladeDistance (const Barrier& b, float qx, float qy, float& nx, float& ny)
+{
+    float ex = abs(qx) - b.hw, ey = abs(qy) - b.hh;
+    float sx = (qx < 0) ? -1 : 1, sy = (qy < 0) ? -1 : 1;
+    if (ex > 0 || ey > 0) {
+        float dx = (ex > 0) ? ex : 0, dy = (ey > 0) ? ey : 0;
+        float d = sqrt(dx*dx + dy*dy);
+        nx = sx*dx/d;
+        ny = sy*dy/d;
+        return d - BALL_RADIUS;
+    }
+    // Centre inside the blade: push out through the nearest face
+    if (ex > ey) {
+        nx = sx; ny = 0;
+        return ex - BALL_RADIUS;
+    }
+    nx = 0; ny = sy;
+    return ey - BALL_RADIUS;
+}
+
+bool sweepBarrier (const Barrier& b, float x0, float y0, float x1, float y1, float dt, Contact& c)
+{
+    // Broad phase: the path never comes within reach of the pivot
+    float px = x1-x0, py = y1-y0;
+    float len2 = px*px + py*py;
+    float u = (len2 > 0) ? ((b.x-x0)*px + (b.y-y0)*py)/len2 : 0;
+    u = (u < 0) ? 0 : (u > 1) ? 1 : u;
+    float cx = x0 + u*px - b.x, cy = y0 + u*py - b.y;
+    float reach = barrierReach(b);
+    if (cx*cx + cy*cy > reach*reach)
+        return false;
+
+    // Conservative advancement in the blade's rotating frame. The gap to
+    // the blade closes no faster than the ball's speed plus the blade's
+    // surface speed at the ball's farthest distance from the pivot, so
+    // stepping by gap/that bound can never step past first contact.
+    float omega = b.spin*(float)(M_PI/180);
+    float r0 = sqrt((x0-b.x)*(x0-b.x) + (y0-b.y)*(y0-b.y));
+    float r1 = sqrt((x1-b.x)*(x1-b.x) + (y1-b.y)*(y1-b.y));
+    float bound = (dt > 0 ? sqrt(len2)/dt : 0) + abs(omega)*((r0 > r1) ? r0 : r1);
+    float th0 = b.prev_rotation*(float)(M_PI/180);
+    float cs = b.prev_cos, sn = b.prev_sin;
+    float t = 0, nx = 0, ny = 0;
+    for (int i=0; i<SWEEP_MAX_ITERATIONS; i++) {
+        float f = (dt > 0) ? t/dt : 1;
+        float dx = x0 + f*px - b.x, dy = y0 + f*py - b.y;
+        float qx = cs*dx + sn*dy, qy = -sn*dx + cs*dy;
+        float d = bladeDistance(b, qx, qy, nx, ny);
+        if (d <= SWEEP_TOLERANCE) {
+            c.toi = t;
+            c.x = b.x + dx;
+            c.y = b.y + dy;
+            c.nx = cs*nx - sn*ny;
+            c.ny = sn*nx + cs*ny;
+            // Surface velocity of the blade where the ball touches it
+            c.vx = -omega*dy;
+            c.vy = omega*dx;
+            return true;
+        }
+        if (bound <= 0)
+            return false;
+        t += d/bound;
+        if (t > dt)
+            return false;
+        float th = th0 + omega*t;
+        cs = cos(th);
+        sn = sin(th);
+    }
+    return false;
+}
+
+/* Swept test of this tick's path against the fans whose reach it passes
+ * through, found through the fan grid. On the earliest contact the ball is
+ * put back where it touched and bounced off the moving blade. */
+static void checkcollisionbarrier (World& w, float dt)
+{
+    w.fans_near.clear();
+    gridCollect(w.fan_grid, w.fan_boxes, w.prev_sx, w.prev_sy, w.sx, w.sy, w.fans_near);
+    Contact first = {};
+    float first_vn = 0;
+    first.toi = INFINITY;
+    for (size_t k=0; k<w.fans_near.size(); k++) {
+        Contact c;
+        if (!sweepBarrier(w.barriers[w.fans_near[k]], w.prev_sx, w.prev_sy, w.sx, w.sy, dt, c))
+            continue;
+        float vn = (w.vx - c.vx)*c.nx + (w.vy - c.vy)*c.ny;
+        // Already separating, e.g. still touching after last tick's bounce
+        if (vn >= 0 || c.toi >= first.toi)
+            continue;
+        first = c;
+        first_vn = vn;
+    }
+    if (first.toi == INFINITY)
+        return;
+    w.sx = first.x + first.nx*BARRIER_CLEARANCE;
+    w.sy = first.y + first.ny*BARRIER_CLEARANCE;
+    w.vx -= (1+BARRIER_RESTITUTION)*first_vn*first.nx;
+    w.vy -= (1+BARRIER_RESTITUTION)*first_vn*first.ny;
+}
+
+static void checkcollisionground (World& w)
+{
+    if (w.resting || w.sy > GROUND_Y)
+        return;
+    // Snap back onto the ground rather than above it, so every bounce
+    // loses energy and the ball settles instead of hopping forever
+    w.sy = GROUND_Y;
+    w.vy = -w.vy/4;
+    w.vx = w.vx*3/5;
+    if (w.vy < REST_SPEED) {
+        w.vy = 0;
+        w.resting = true;
+    }
+}
+
+/* Keep animation angles small so long headless runs don't lose precision */
+static float spinangle (float angle, float spin, float dt)
+{
+    return fmod(angle + spin*dt, 360.0f);
+}
+
+/* Turn every animated object by dt, refreshing the fans' cached sin/cos.
+ * Static blocks are never visited. */
+static void spinAll (World& w, float dt)
+{
+    for (size_t k=0; k<w.spinning.size(); k++) {
+        Target& t = w.targets[w.spinning[k]];
+        t.rotation = spinangle(t.rotation, t.spin, dt);
+    }
+    for (size_t i=0; i<w.barriers.size(); i++) {
+        Barrier& b = w.barriers[i];
+        b.rotation = spinangle(b.rotation, b.spin, dt);
+        float th = b.rotation*(float)(M_PI/180);
+        b.cos_rot = cos(th);
+        b.sin_rot = sin(th);
+    }
+    w.bullet_rotation = spinangle(w.bullet_rotation, BULLET_SPIN, dt);
+}
+
+void updateWorld (World& w, float dt)
+{
+    ProfileScope tick(ZONE_UPDATE);
+    snapPrevious(w);
+    spinAll(w, dt);
+
+    if (!w.in_flight)
+        cannonanglecheck(w, dt);
+    else {
+        integrate(w, dt);
+        ProfileScope collision(ZONE_COLLISION);
+        checkcollisiontargets(w);
+        checkcollisionbarrier(w, dt);
+        checkcollisionground(w);
+    }
+
+    w.time += dt;
+    w.ticks++;
+}
+
+long simulateShot (World& w, float angle, double charge_seconds, float dt, double max_time)
+{
+    reloadCannon(w);
+    w.cannon_rotation = angle;
+    fireCannon(w, charge_seconds);
+    double start = w.time;
+    long ticks = 0;
+    while (!shotFinished(w) && w.time - start < max_time) {
+        updateWorld(w, dt);
+        ticks++;
+    }
+    return ticks;
+}
+
+void initClock (SimClock& c, double hz)
+{
+    c.step = 1.0/hz;
+    c.accumulator = 0;
+    c.max_ticks = SIM_MAX_TICKS;
+}
+
+float advanceClock (SimClock& c, World& w, double elapsed, TickHook hook, void* arg)
+{
+    c.accumulator += elapsed;
+    int n = 0;
+    while (c.accumulator >= c.step && n < c.max_ticks) {
+        if (hook)
+            hook(arg, c.accumulator - c.step);
+        updateWorld(w, c.step);
+        c.accumulator -= c.step;
+        n++;
+    }
+    // Too far behind to catch up: drop the backlog rather than run ever
+    // more ticks per frame
+    if (c.accumulator >= c.step)
+        c.accumulator = 0;
+    return c.accumulator/c.step;
+}
+
+float lerpValue (float prev, float cur, float alpha)
+{
+    return prev + (cur-prev)*alpha;
+}
+
+float lerpAngle (float prev, float cur, float alpha)
+{
+    float d = fmod(cur-prev, 360.0f);
+    if (d > 180)
+        d -= 360;
+    else if (d < -180)
+        d += 360;
+    return prev + d*alpha;
+}
+
+/*************************
+ * Event-driven stepping *
+ *************************/
+
+#define EVENT_EPS  1e-7     // seconds; contacts closer than this count as now
+#define BOX_TOL    1e-4f    // slack on box tests so a root on the face counts as inside
+
+enum EventKind { EVENT_NONE, EVENT_PHASE, EVENT_TARGET, EVENT_GROUND, EVENT_WALL, EVENT_FAN };
+
+/* Constant-acceleration motion of the ball from now until the next event */
+struct Motion {
+    double x0, vx, ax;
+    double y0, vy, ay;
+};
+
+static double posAt (double p0, double v, double a, double t)
+{
+    return p0 + v*t + 0.5*a*t*t;
+}
+
+/* Roots of a*t^2 + b*t + c = 0 in (EVENT_EPS, tmax], appended to out */
+static int quadRoots (double a, double b, double c, double tmax, double* out)
+{
+    double r[2];
+    int n = 0;
+    if (abs(a) < 1e-12) {
+        if (abs(b) < 1e-12)
+            return 0;
+        r[n++] = -c/b;
+    }
+    else {
+        double disc = b*b - 4*a*c;
+        if (disc < 0)
+            return 0;
+        // Numerically stable form, no cancellation between b and sqrt(disc)
+        double q = -0.5*(b + (b >= 0 ? sqrt(disc) : -sqrt(disc)));
+        r[n++] = q/a;
+        if (q != 0)
+            r[n++] = c/q;
+    }
+    int k = 0;
+    for (int i=0; i<n; i++)
+        if (r[i] > EVENT_EPS && r[i] <= tmax)
+            out[k++] = r[i];
+    return k;
+}
+
+static bool insideBox (double x, double y, float cx, float cy, float hx, float hy)
+{
+    return abs(x-cx) <= hx+BOX_TOL && abs(y-cy) <= hy+BOX_TOL;
+}
+
+/* Earliest time in [0, tmax] the ball is inside the box, or -1. It is
+ * either now or the moment it crosses one of the four face lines. */
+static double boxEntry (const Motion& m, float cx, float cy, float hx, float hy, double tmax)
+{
+    double cand[9];
+    int n = 0;
+    cand[n++] = 0;
+    n += quadRoots(0.5*m.ax, m.vx, m.x0-(cx-hx), tmax, cand+n);
+    n += quadRoots(0.5*m.ax, m.vx, m.x0-(cx+hx), tmax, cand+n);
+    n += quadRoots(0.5*m.ay, m.vy, m.y0-(cy-hy), tmax, cand+n);
+    n += quadRoots(0.5*m.ay, m.vy, m.y0-(cy+hy), tmax, cand+n);
+    for (int i=1; i<n; i++)
+        for (int j=i; j>0 && cand[j] < cand[j-1]; j--)
+            swap(cand[j], cand[j-1]);
+    for (int i=0; i<n; i++)
+        if (insideBox(posAt(m.x0, m.vx, m.ax, cand[i]), posAt(m.y0, m.vy, m.ay, cand[i]), cx, cy, hx, hy))
+            return cand[i];
+    return -1;
+}
+
+/* Move along m for t seconds, spinning everything as updateWorld() would */
+static void drift (World& w, const Motion& m, double t)
+{
+    snapPrevious(w);
+    spinAll(w, t);
+
+    w.sx = posAt(m.x0, m.vx, m.ax, t);
+    w.vx = m.vx + m.ax*t;
+    w.sy = posAt(m.y0, m.vy, m.ay, t);
+    w.vy = m.vy + m.ay*t;
+    w.time += t;
+    w.ticks++;
+}
+
+double advanceToEvent (World& w, double max_dt, float fan_dt)
+{
+    // Nothing to solve for, or inside a fan's reach where the blade angle
+    // makes contact non-polynomial: take an ordinary tick
+    bool near_fan = !w.in_flight;
+    for (size_t i=0; i<w.barriers.size() && !near_fan; i++) {
+        float reach = barrierReach(w.barriers[i]);
+        near_fan = insideBox(w.sx, w.sy, w.barriers[i].x, w.barriers[i].y, reach, reach);
+    }
+    if (near_fan) {
+        float dt = (max_dt < fan_dt) ? max_dt : fan_dt;
+        updateWorld(w, dt);
+        return dt;
+    }
+
+    // Accelerations hold until the next phase change: air braking stops at
+    // AIR_MIN_SPEED, rolling friction stops the ball dead
+    Motion m;
+    m.x0 = w.sx; m.vx = w.vx;
+    m.y0 = w.sy; m.vy = w.vy;
+    double tevent = max_dt;
+    EventKind kind = EVENT_NONE;
+    if (w.resting) {
+        m.ax = (w.vx > 0) ? -ROLL_FRICTION : (w.vx < 0) ? ROLL_FRICTION : 0;
+        m.ay = 0;
+        if (w.vx != 0 && abs(w.vx)/ROLL_FRICTION < tevent) {
+            tevent = abs(w.vx)/ROLL_FRICTION;
+            kind = EVENT_PHASE;
+        }
+    }
+    else {
+        m.ax = (w.vx > AIR_MIN_SPEED && w.ax < 0) ? w.ax : 0;
+        m.ay = w.ay;
+        if (m.ax < 0 && (AIR_MIN_SPEED-w.vx)/m.ax < tevent) {
+            tevent = (AIR_MIN_SPEED-w.vx)/m.ax;
+            kind = EVENT_PHASE;
+        }
+    }
+
+    double roots[2];
+    int n;
+    if (!w.resting) {
+        // Ground: the crossing on the way down
+        n = quadRoots(0.5*m.ay, m.vy, m.y0-GROUND_Y, tevent, roots);
+        for (int i=0; i<n; i++)
+            if (m.vy + m.ay*roots[i] < 0 && roots[i] < tevent) {
+                tevent = roots[i];
+                kind = EVENT_GROUND;
+            }
+        if (w.sy <= GROUND_Y && w.vy <= 0) {
+            tevent = 0;
+            kind = EVENT_GROUND;
+        }
+    }
+
+    n = quadRoots(0.5*m.ax, m.vx, m.x0-ARENA_HALF_WIDTH, tevent, roots);
+    n += quadRoots(0.5*m.ax, m.vx, m.x0+ARENA_HALF_WIDTH, tevent, roots+n);
+    for (int i=0; i<n; i++)
+        if (roots[i] < tevent) {
+            tevent = roots[i];
+            kind = EVENT_WALL;
+        }
+
+    int hit = -1;
+    for (size_t i=0; i<w.targets.size(); i++) {
+        Target& t = w.targets[i];
+        if (t.destroyed)
+            continue;
+        double te = boxEntry(m, t.x, t.y, t.hx, t.hy, tevent);
+        if (te >= 0 && (te < tevent || (te == tevent && kind != EVENT_TARGET))) {
+            tevent = te;
+            kind = EVENT_TARGET;
+            hit = i;
+        }
+    }
+
+    for (size_t i=0; i<w.barriers.size(); i++) {
+        const Barrier& b = w.barriers[i];
+        double te = boxEntry(m, b.x, b.y, barrierReach(b), barrierReach(b), tevent);
+        if (te >= 0 && te < tevent) {
+            tevent = te;
+            kind = EVENT_FAN;
+        }
+    }
+
+    drift(w, m, tevent);
+    switch (kind) {
+        case EVENT_PHASE:
+            // Land exactly on the phase boundary so it isn't found again
+            if (w.resting)
+                w.vx = 0;
+            else
+                w.vx = AIR_MIN_SPEED;
+            break;
+        case EVENT_TARGET:
+            hittarget(w, hit);
+            break;
+        case EVENT_GROUND:
+            w.sy = GROUND_Y;
+            checkcollisionground(w);
+            break;
+        case EVENT_WALL:
+            w.sx = (w.sx > 0) ? ARENA_HALF_WIDTH : -ARENA_HALF_WIDTH;
+            break;
+        default:
+            break;
+    }
+    return tevent;
+}
+
+long simulateShotEvents (World& w, float angle, double charge_seconds, float fan_dt, double max_time)
+{
+    reloadCannon(w);
+    w.cannon_rotation = angle;
+    fireCannon(w, charge_seconds);
+    double start = w.time;
+    long steps = 0;
+    while (!shotFinished(w) && w.time - start < max_time) {
+        advanceToEvent(w, start + max_time - w.time, fan_dt);
+        steps++;
+    }
+    return steps;
+}
+
+void poseWorld (World& w, float degrees)
+{
+    float th = degrees*(float)(M_PI/180);
+    for (size_t k=0; k<w.spinning.size(); k++)
+        w.targets[w.spinning[k]].rotation = degrees;
+    for (size_t i=0; i<w.barriers.size(); i++) {
+        Barrier& b = w.barriers[i];
+        b.rotation = degrees;
+        b.cos_rot = cos(th);
+        b.sin_rot = sin(th);
+    }
+    snapPrevious(w);
+}
@@ -0,0 +1,196 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <vector>
+
+#include "grid.h"
+
+struct Level;
+
+/* Headless game simulation.
+ * Everything draw() used to compute inline (projectile motion, collisions,
+ * score, animation angles) lives here. Nothing in this file touches GL or
+ * GLFW, so it links into the game as well as into the headless tools. */
+
+/* Legacy per-frame increments of draw() converted to per-second rates at the
+ * 60 Hz the game was tuned on */
+#define CANNON_TURN_RATE    60.0f   // degrees/sec while UP/DOWN is held
+#define SQUARE5_SPIN       180.0f   // degrees/sec
+#define BARRIER_SPIN       120.0f   // degrees/sec
+#define BULLET_SPIN       6000.0f   // degrees/sec
+
+#define CANNON_X        -9.0f
+#define CANNON_Y        -4.0f
+#define CANNON_LENGTH    2.0f
+#define CANNON_MIN     -45.0f
+#define CANNON_MAX      75.0f
+
+/* Muzzle speed per unit of power (charge*powerfac). The old draw() moved
+ * the ball by u*t every frame with t the time since launch over 5, about
+ * 6*u*T^2 after T seconds at 60 Hz; this gain makes a shot cover the same
+ * ground in its first second as it did at 60 Hz. */
+#define LAUNCH_GAIN      6.0f
+#define GROUND_Y        -5.9f
+#define ARENA_HALF_WIDTH 11.2f  // inner faces of the side walls
+#define BALL_RADIUS      0.15f
+#define REST_SPEED       0.05f  // bounce speed below which the ball settles
+#define ROLL_FRICTION    5.0f   // deceleration of a ball rolling on the ground
+#define AIR_MIN_SPEED    0.01f  // air resistance only acts above this forward speed
+#define WIN_SCORE        90
+
+/* A destructible block, from a LEVEL_TARGET record */
+struct Target {
+    float x, y;             // centre
+    float hx, hy;           // half extents of the hit box
+    float side_x;           // hit while left of this -> bounce off the side
+    float top_y;            // hit while above this -> bounce off the top
+    float rotation, spin;   // degrees, degrees/sec (display only)
+    float prev_rotation;    // rotation before the last tick
+    int score;
+    bool bounce_both;       // reflect both velocity components
+    bool destroyed;
+    int object;             // index of its level record, for drawing
+};
+
+/* One of the spinning green fans. The blade is the box of half extents
+ * hw x hh about the pivot, turned by rotation (as drawn). */
+struct Barrier {
+    float x, y;             // pivot
+    float hw, hh;           // half width/height of the blade
+    float rotation, spin;   // degrees, degrees/sec
+    float prev_rotation;    // rotation before the last tick
+    float cos_rot, sin_rot; // of rotation, refreshed once per tick
+    float prev_cos, prev_sin;
+    int object;             // index of its level record, for drawing
+};
+
+/* First touch found by sweepBarrier() */
+struct Contact {
+    float toi;              // seconds into the tick
+    float x, y;             // ball centre at contact
+    float nx, ny;           // unit normal out of the blade
+    float vx, vy;           // blade surface velocity at the contact
+};
+
+struct World {
+    // Projectile
+    float sx, sy;           // position
+    float vx, vy;           // velocity
+    float ax, ay;           // air resistance, gravity
+    float powerfac;
+    bool in_flight;
+    bool resting;           // settled on the ground
+
+    // Cannon
+    float cannon_rotation;  // degrees
+    int cannonrotflag;      // -1, 0, 1 while DOWN/none/UP is held
+
+    float bullet_rotation;
+
+    std::vector<Target> targets;
+    std::vector<int> spinning;  // targets that spin, the only ones a tick turns
+    std::vector<int> knocked;   // targets in the order they were destroyed
+    int standing;           // targets not yet destroyed
+    TargetGrid grid;        // broadphase over the standing targets
+    std::vector<Barrier> barriers;
+    std::vector<Target> fan_boxes;  // each fan's reach as a box about its pivot
+    TargetGrid fan_grid;    // broadphase over fan_boxes
+    std::vector<int> fans_near; // fans along this tick's path
+
+    // Render transforms before the last tick, for interpolation
+    float prev_sx, prev_sy;
+    float prev_cannon_rotation, prev_bullet_rotation;
+
+    int flagscore;
+    double time;            // simulated seconds
+    long ticks;
+};
+
+/* Fixed-step simulation clock. Real time is banked in an accumulator and
+ * spent in whole ticks of 1/hz seconds, so gameplay is the same at any
+ * frame rate; the leftover fraction is used to blend the last two ticks
+ * for display. */
+struct SimClock {
+    double step;            // seconds per tick
+    double accumulator;     // real time not yet simulated
+    int max_ticks;          // per advance, so a long stall can't snowball
+};
+
+#define SIM_HZ          240
+#define SIM_MAX_TICKS   32
+
+/* Gravity and air resistance for the choices main() offers:
+ * 1 EARTH / 2 MOON, and 1 LOW / 2 MEDIUM / 3 HIGH */
+float gravityPreset (int choice);
+float airPreset (int choice);
+
+/* Reset to a level with the given gravity and air resistance. The targets
+ * and fans are copied out of the level's records; it is not kept. */
+void initWorld (World& w, const Level& level, float ax, float ay);
+
+/* Reset to the stock level, level 1 */
+void initWorld (World& w, float ax, float ay);
+
+/* Advance the simulation by dt seconds */
+void updateWorld (World& w, float dt);
+
+/* Release a shot charged for charge_seconds at the current cannon angle */
+void fireCannon (World& w, double charge_seconds);
+
+/* Put the ball back into the cannon */
+void reloadCannon (World& w);
+
+/* True once the ball has come to rest or left the arena */
+bool shotFinished (const World& w);
+
+/* Aim, fire and step the world in dt increments until the shot is finished
+ * or max_time simulated seconds have passed. Returns the ticks taken. */
+long simulateShot (World& w, float angle, double charge_seconds, float dt, double max_time);
+
+/* Swept test of a ball moving in a straight line from (x0,y0) to (x1,y1)
+ * over dt seconds against a fan turning from b.prev_rotation at b.spin.
+ * Finds the first time of impact at any ball speed and spin rate. */
+bool sweepBarrier (const Barrier& b, float x0, float y0, float x1, float y1, float dt, Contact& c);
+
+/* Farthest a ball centre can be from the pivot and still touch the blade */
+float barrierReach (const Barrier& b);
+
+/* Event-driven alternative to updateWorld() for a shot in flight. Between
+ * contacts the ball follows a closed-form parabola, so this solves for the
+ * next contact with a target, the ground, a side wall or the end of air
+ * braking and jumps straight there. Inside a fan's reach, where the blade
+ * angle keeps contact from having a closed form, it takes ordinary ticks of
+ * fan_dt. Advances at most max_dt; returns the time advanced. */
+double advanceToEvent (World& w, double max_dt, float fan_dt);
+
+/* simulateShot() stepping with advanceToEvent(). Returns the steps taken. */
+long simulateShotEvents (World& w, float angle, double charge_seconds, float fan_dt, double max_time);
+
+/* Start a clock ticking hz times per simulated second */
+void initClock (SimClock& c, double hz);
+
+/* Called before each tick advanceClock() runs, with how many seconds
+ * before the present that tick ends */
+typedef void (*TickHook)(void* arg, double lag);
+
+/* Run as many fixed ticks as elapsed real seconds cover, calling hook (if
+ * not NULL) before each. Returns how far real time is into the next tick,
+ * 0..1, for interpolation. */
+float advanceClock (SimClock& c, World& w, double elapsed, TickHook hook, void* arg);
+
+/* Blend from the previous tick's value to the current one */
+float lerpValue (float prev, float cur, float alpha);
+float lerpAngle (float prev, float cur, float alpha);   // degrees, across the 360 wrap
+
+/* Number of targets still standing, kept as they fall */
+int targetsLeft (const World& w);
+
+/* Knock target i down as a hit would, leaving the ball where it is */
+void knockDown (World& w, int i);
+
+/* Pose for a still picture: every fan and spinning target turned to
+ * degrees, and the previous tick made the same as this one, so drawing at
+ * any alpha shows exactly this state */
+void poseWorld (World& w, float degrees);
+
+#endif